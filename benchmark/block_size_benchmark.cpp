@@ -0,0 +1,131 @@
+// Measures how the block size and the prefetch depth of LineReader and
+// CSVReader affect throughput and memory usage.
+//
+// Usage: block_size_benchmark [file.csv]
+//
+// If no file is given, a CSV file with three integer columns and one string
+// column is generated in the current directory. The output is a tab
+// separated table with one row per block size and reader.
+
+#include "../csv.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+const char *generated_file_name = "block_size_benchmark.csv";
+
+void generate_file(const char *file_name, long long row_count) {
+  std::FILE *file = std::fopen(file_name, "wb");
+  if (!file) {
+    std::perror(file_name);
+    std::exit(1);
+  }
+  std::fputs("a,b,c,d\n", file);
+  unsigned long long state = 42;
+  for (long long i = 0; i < row_count; ++i) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    unsigned x = (unsigned)(state >> 33);
+    std::fprintf(file, "%lld,%u,%u,%.*s\n", i, x, x % 1000, (int)(x % 32),
+                 "abcdefghijklmnopqrstuvwxyzABCDEF");
+  }
+  std::fclose(file);
+}
+
+long long get_file_size(const char *file_name) {
+  std::FILE *file = std::fopen(file_name, "rb");
+  if (!file) {
+    std::perror(file_name);
+    std::exit(1);
+  }
+  std::fseek(file, 0, SEEK_END);
+  long long size = std::ftell(file);
+  std::fclose(file);
+  return size;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+template <class block_policy>
+double time_line_reader(const char *file_name, long long &checksum) {
+  auto start = std::chrono::steady_clock::now();
+  io::BasicLineReader<block_policy> in(file_name);
+  in.set_max_line_length(1 << 20);
+  while (char *line = in.next_line())
+    checksum += line[0];
+  return seconds_since(start);
+}
+
+template <class block_policy>
+double time_csv_reader(const char *file_name, long long &checksum) {
+  auto start = std::chrono::steady_clock::now();
+  io::CSVReader<4, io::trim_chars<' ', '\t'>, io::no_quote_escape<','>,
+                io::throw_on_overflow, io::no_comment, block_policy>
+      in(file_name);
+  in.set_max_line_length(1 << 20);
+  in.read_header(io::ignore_no_column, "a", "b", "c", "d");
+  long long a;
+  unsigned b, c;
+  char *d;
+  while (in.read_row(a, b, c, d))
+    checksum += a + b + c + d[0];
+  return seconds_since(start);
+}
+
+template <int block_byte_count, int prefetch_block_count = 1>
+void run(const char *file_name, long long file_size, int repeat_count) {
+  typedef io::block_size<block_byte_count, prefetch_block_count> policy;
+  long long checksum = 0;
+  double line_time = 1e300, csv_time = 1e300;
+  for (int i = 0; i < repeat_count; ++i) {
+    line_time = std::min(line_time, time_line_reader<policy>(file_name, checksum));
+    csv_time = std::min(csv_time, time_csv_reader<policy>(file_name, checksum));
+  }
+  double mib = file_size / 1048576.0;
+  long long buffer_bytes = (2LL + prefetch_block_count) * block_byte_count;
+  std::printf("%d\t%d\t%lld\tLineReader\t%.1f\t%lld\n", block_byte_count,
+              prefetch_block_count, buffer_bytes, mib / line_time,
+              checksum & 1);
+  std::printf("%d\t%d\t%lld\tCSVReader\t%.1f\t%lld\n", block_byte_count,
+              prefetch_block_count, buffer_bytes, mib / csv_time,
+              checksum & 1);
+  std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const char *file_name = generated_file_name;
+  if (argc > 1)
+    file_name = argv[1];
+  else
+    generate_file(file_name, 10000000);
+
+  long long file_size = get_file_size(file_name);
+  const int repeat_count = 3;
+
+  // The last column only keeps the optimizer from removing the loops.
+  std::printf("block_bytes\tprefetch_blocks\tbuffer_bytes\treader\tMiB_per_s\t"
+              "checksum_bit\n");
+  run<4 << 10>(file_name, file_size, repeat_count);
+  run<16 << 10>(file_name, file_size, repeat_count);
+  run<64 << 10>(file_name, file_size, repeat_count);
+  run<256 << 10>(file_name, file_size, repeat_count);
+  run<1 << 20>(file_name, file_size, repeat_count);
+  run<4 << 20>(file_name, file_size, repeat_count);
+  run<16 << 20>(file_name, file_size, repeat_count);
+
+  run<1 << 20, 0>(file_name, file_size, repeat_count);
+  run<1 << 20, 4>(file_name, file_size, repeat_count);
+  run<1 << 20, 16>(file_name, file_size, repeat_count);
+
+  if (argc <= 1)
+    std::remove(file_name);
+}
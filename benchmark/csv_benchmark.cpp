@@ -0,0 +1,434 @@
+// Measures the throughput of CSVReader on synthetic data sets for a matrix of
+// policies.
+//
+// Usage: csv_benchmark [--size-mb N] [--repeat N] [--dir DIR] [--keep]
+//                      [--no-header]
+//
+// Five data sets are generated into DIR: integer heavy, float heavy, quoted
+// strings, 1000 columns and comment laden. The generators are deterministic,
+// so the files are identical on every machine. Every data set is read once
+// with LineReader as a baseline and then with CSVReader for every applicable
+// combination of policies. The output is a tab separated table with one row
+// per measurement. Compile with and without CSV_IO_NO_THREAD to compare both,
+// see run.sh.
+
+#include "../csv.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+#ifdef CSV_IO_NO_THREAD
+const char *threading = "no_thread";
+#else
+const char *threading = "thread";
+#endif
+
+struct Options {
+  long long byte_count = 64LL << 20;
+  int repeat_count = 3;
+  std::string dir = ".";
+  bool keep_files = false;
+  bool print_header = true;
+};
+
+Options options;
+
+// A small deterministic generator, so that the data sets do not depend on the
+// standard library.
+class Random {
+public:
+  unsigned long long next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  unsigned below(unsigned bound) {
+    return static_cast<unsigned>(next() % bound);
+  }
+
+private:
+  unsigned long long state = 0x9E3779B97F4A7C15ULL;
+};
+
+////////////////////////////////////////////////////////////////////////////
+//                              Generators                                //
+////////////////////////////////////////////////////////////////////////////
+
+std::FILE *create_file(const std::string &file_name) {
+  std::FILE *file = std::fopen(file_name.c_str(), "wb");
+  if (!file) {
+    std::perror(file_name.c_str());
+    std::exit(1);
+  }
+  return file;
+}
+
+void generate_ints(const std::string &file_name) {
+  std::FILE *file = create_file(file_name);
+  Random random;
+  std::fputs("id,a,b,c,d,e,f,g\n", file);
+  for (long long i = 0; std::ftell(file) < options.byte_count; ++i) {
+    unsigned long long x = random.next();
+    std::fprintf(file, "%lld,%u,%d,%u,%lld,%u,%d,%llu\n", i,
+                 static_cast<unsigned>(x), -static_cast<int>(x % 100000),
+                 random.below(100),
+                 static_cast<long long>(x >> 1) * (x & 1 ? 1 : -1),
+                 random.below(65536), static_cast<int>(random.below(2000)) - 1000,
+                 random.next());
+  }
+  std::fclose(file);
+}
+
+void generate_floats(const std::string &file_name) {
+  std::FILE *file = create_file(file_name);
+  Random random;
+  std::fputs("a,b,c,d,e,f\n", file);
+  while (std::ftell(file) < options.byte_count) {
+    double x = static_cast<double>(random.next() >> 11) / (1ULL << 53);
+    double y = static_cast<double>(random.next() >> 11);
+    std::fprintf(file, "%.17g,%.3f,%.6e,%.2f,%g,%.15e\n", x, x * 1000,
+                 y * 1e-300, -x * 100, y, x * 1e200);
+  }
+  std::fclose(file);
+}
+
+void generate_quoted(const std::string &file_name) {
+  static const char *names[] = {"Smith, John", "Doe, Jane", "O'Brien, Pat",
+                                "Miller", "Nguyen, Anh"};
+  static const char *comments[] = {
+      "He said \"\"hi\"\"", "plain text", "a, b, and c",
+      "\"\"quoted\"\" at the begin", "nothing special here at all"};
+  std::FILE *file = create_file(file_name);
+  Random random;
+  std::fputs("id,name,comment,value\n", file);
+  for (long long i = 0; std::ftell(file) < options.byte_count; ++i)
+    std::fprintf(file, "%lld,\"%s\",\"%s\",%u\n", i, names[random.below(5)],
+                 comments[random.below(5)], random.below(1000000));
+  std::fclose(file);
+}
+
+const int wide_column_count = 1000;
+
+void generate_wide(const std::string &file_name) {
+  std::FILE *file = create_file(file_name);
+  Random random;
+  for (int i = 0; i < wide_column_count; ++i)
+    std::fprintf(file, i == 0 ? "c%d" : ",c%d", i);
+  std::fputc('\n', file);
+  while (std::ftell(file) < options.byte_count) {
+    for (int i = 0; i < wide_column_count; ++i)
+      std::fprintf(file, i == 0 ? "%u" : ",%u", random.below(1000));
+    std::fputc('\n', file);
+  }
+  std::fclose(file);
+}
+
+void generate_comments(const std::string &file_name) {
+  std::FILE *file = create_file(file_name);
+  Random random;
+  std::fputs("a,b,c\n", file);
+  while (std::ftell(file) < options.byte_count) {
+    switch (random.below(4)) {
+    case 0:
+      std::fputs("# a comment line that is skipped by the comment policy\n",
+                 file);
+      break;
+    case 1:
+      std::fputs("\n", file);
+      break;
+    default:
+      std::fprintf(file, "%u,%u,%u\n", random.below(100000),
+                   random.below(100), random.below(10));
+    }
+  }
+  std::fclose(file);
+}
+
+////////////////////////////////////////////////////////////////////////////
+//                              Measurement                               //
+////////////////////////////////////////////////////////////////////////////
+
+long long get_file_size(const std::string &file_name) {
+  std::FILE *file = std::fopen(file_name.c_str(), "rb");
+  std::fseek(file, 0, SEEK_END);
+  long long size = std::ftell(file);
+  std::fclose(file);
+  return size;
+}
+
+// The sum of all parsed values keeps the optimizer from removing the loops.
+volatile long long sink;
+
+template <class Function>
+void measure(const std::string &dataset, const std::string &file_name,
+             const char *reader, const char *trim, const char *quote,
+             const char *overflow, const char *comment, Function parse) {
+  double best_seconds = 1e300;
+  long long row_count = 0;
+  for (int i = 0; i < options.repeat_count; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    row_count = parse(file_name);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    if (seconds < best_seconds)
+      best_seconds = seconds;
+  }
+  long long byte_count = get_file_size(file_name);
+  std::printf("%s\t%s\t%s\t%s\t%s\t%s\t%s\t%lld\t%lld\t%.6f\t%.1f\t%.0f\n",
+              dataset.c_str(), reader, threading, trim, quote, overflow,
+              comment, byte_count, row_count, best_seconds,
+              byte_count / 1048576.0 / best_seconds, row_count / best_seconds);
+  std::fflush(stdout);
+}
+
+long long read_lines(const std::string &file_name) {
+  io::LineReader in(file_name);
+  long long row_count = 0, sum = 0;
+  while (char *line = in.next_line()) {
+    sum += line[0];
+    ++row_count;
+  }
+  sink = sum;
+  return row_count;
+}
+
+void measure_line_reader(const std::string &dataset,
+                         const std::string &file_name) {
+  measure(dataset, file_name, "LineReader", "-", "-", "-", "-", read_lines);
+}
+
+// Maps the policies to the names in the output.
+template <class policy> struct name_of;
+template <> struct name_of<io::trim_chars<>> {
+  static const char *get() { return "none"; }
+};
+template <> struct name_of<io::trim_chars<' ', '\t'>> {
+  static const char *get() { return "space_tab"; }
+};
+template <> struct name_of<io::no_quote_escape<','>> {
+  static const char *get() { return "no_quote_escape"; }
+};
+template <> struct name_of<io::double_quote_escape<',', '"'>> {
+  static const char *get() { return "double_quote_escape"; }
+};
+template <> struct name_of<io::throw_on_overflow> {
+  static const char *get() { return "throw_on_overflow"; }
+};
+template <> struct name_of<io::ignore_overflow> {
+  static const char *get() { return "ignore_overflow"; }
+};
+template <> struct name_of<io::set_to_max_on_overflow> {
+  static const char *get() { return "set_to_max_on_overflow"; }
+};
+template <> struct name_of<io::no_comment> {
+  static const char *get() { return "no_comment"; }
+};
+template <> struct name_of<io::single_and_empty_line_comment<'#'>> {
+  static const char *get() { return "single_and_empty_line_comment"; }
+};
+
+template <class trim, class quote, class overflow, class comment,
+          class Function>
+void measure_csv_reader(const std::string &dataset,
+                        const std::string &file_name, Function parse) {
+  measure(dataset, file_name, "CSVReader", name_of<trim>::get(),
+          name_of<quote>::get(), name_of<overflow>::get(),
+          name_of<comment>::get(), parse);
+}
+
+////////////////////////////////////////////////////////////////////////////
+//                               Data Sets                                //
+////////////////////////////////////////////////////////////////////////////
+
+template <class trim, class quote, class overflow>
+void run_ints(const std::string &file_name) {
+  measure_csv_reader<trim, quote, overflow, io::no_comment>(
+      "ints", file_name, [](const std::string &file_name) {
+        io::CSVReader<8, trim, quote, overflow> in(file_name);
+        in.read_header(io::ignore_no_column, "id", "a", "b", "c", "d", "e",
+                       "f", "g");
+        long long id, d;
+        unsigned a, c, e;
+        int b, f;
+        unsigned long long g;
+        long long row_count = 0, sum = 0;
+        while (in.read_row(id, a, b, c, d, e, f, g)) {
+          sum += id + a + b + c + d + e + f + static_cast<long long>(g);
+          ++row_count;
+        }
+        sink = sum;
+        return row_count;
+      });
+}
+
+template <class trim, class quote>
+void run_ints_overflow(const std::string &file_name) {
+  run_ints<trim, quote, io::throw_on_overflow>(file_name);
+  run_ints<trim, quote, io::ignore_overflow>(file_name);
+  run_ints<trim, quote, io::set_to_max_on_overflow>(file_name);
+}
+
+template <class trim, class quote>
+void run_floats(const std::string &file_name) {
+  measure_csv_reader<trim, quote, io::throw_on_overflow, io::no_comment>(
+      "floats", file_name, [](const std::string &file_name) {
+        io::CSVReader<6, trim, quote> in(file_name);
+        in.read_header(io::ignore_no_column, "a", "b", "c", "d", "e", "f");
+        double a, b, c, d, e, f;
+        long long row_count = 0;
+        double sum = 0;
+        while (in.read_row(a, b, c, d, e, f)) {
+          sum += a + b + c + d + e + f;
+          ++row_count;
+        }
+        sink = static_cast<long long>(sum);
+        return row_count;
+      });
+}
+
+template <class trim> void run_quoted(const std::string &file_name) {
+  typedef io::double_quote_escape<',', '"'> quote;
+  measure_csv_reader<trim, quote, io::throw_on_overflow, io::no_comment>(
+      "quoted", file_name, [](const std::string &file_name) {
+        io::CSVReader<4, trim, quote> in(file_name);
+        in.read_header(io::ignore_no_column, "id", "name", "comment",
+                       "value");
+        long long id;
+        char *name, *comment;
+        unsigned value;
+        long long row_count = 0, sum = 0;
+        while (in.read_row(id, name, comment, value)) {
+          sum += id + name[0] + comment[0] + value;
+          ++row_count;
+        }
+        sink = sum;
+        return row_count;
+      });
+}
+
+template <class trim, class quote>
+void run_wide(const std::string &file_name) {
+  // Only four columns are converted, but every column is tokenized.
+  measure_csv_reader<trim, quote, io::throw_on_overflow, io::no_comment>(
+      "wide", file_name, [](const std::string &file_name) {
+        io::CSVReader<4, trim, quote> in(file_name);
+        in.read_header(io::ignore_extra_column, "c0", "c333", "c666", "c999");
+        int a, b, c, d;
+        long long row_count = 0, sum = 0;
+        while (in.read_row(a, b, c, d)) {
+          sum += a + b + c + d;
+          ++row_count;
+        }
+        sink = sum;
+        return row_count;
+      });
+}
+
+template <class trim> void run_comments(const std::string &file_name) {
+  typedef io::single_and_empty_line_comment<'#'> comment;
+  measure_csv_reader<trim, io::no_quote_escape<','>, io::throw_on_overflow,
+                     comment>(
+      "comments", file_name, [](const std::string &file_name) {
+        io::CSVReader<3, trim, io::no_quote_escape<','>,
+                      io::throw_on_overflow, comment>
+            in(file_name);
+        in.read_header(io::ignore_no_column, "a", "b", "c");
+        int a, b, c;
+        long long row_count = 0, sum = 0;
+        while (in.read_row(a, b, c)) {
+          sum += a + b + c;
+          ++row_count;
+        }
+        sink = sum;
+        return row_count;
+      });
+}
+
+typedef io::trim_chars<> no_trim;
+typedef io::trim_chars<' ', '\t'> space_tab_trim;
+typedef io::no_quote_escape<','> no_quote;
+typedef io::double_quote_escape<',', '"'> double_quote;
+
+void parse_arguments(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--size-mb" && i + 1 < argc)
+      options.byte_count = std::atoll(argv[++i]) << 20;
+    else if (arg == "--repeat" && i + 1 < argc)
+      options.repeat_count = std::atoi(argv[++i]);
+    else if (arg == "--dir" && i + 1 < argc)
+      options.dir = argv[++i];
+    else if (arg == "--keep")
+      options.keep_files = true;
+    else if (arg == "--no-header")
+      options.print_header = false;
+    else {
+      std::fprintf(stderr,
+                   "Usage: %s [--size-mb N] [--repeat N] [--dir DIR] [--keep] "
+                   "[--no-header]\n",
+                   argv[0]);
+      std::exit(1);
+    }
+  }
+  if (options.repeat_count < 1)
+    options.repeat_count = 1;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  parse_arguments(argc, argv);
+
+  if (options.print_header)
+    std::printf("dataset\treader\tthreading\ttrim\tquote\toverflow\tcomment\t"
+                "bytes\trows\tbest_seconds\tMiB_per_s\trows_per_s\n");
+
+  std::string ints = options.dir + "/bench_ints.csv";
+  generate_ints(ints);
+  measure_line_reader("ints", ints);
+  run_ints_overflow<no_trim, no_quote>(ints);
+  run_ints_overflow<no_trim, double_quote>(ints);
+  run_ints_overflow<space_tab_trim, no_quote>(ints);
+  run_ints_overflow<space_tab_trim, double_quote>(ints);
+
+  std::string floats = options.dir + "/bench_floats.csv";
+  generate_floats(floats);
+  measure_line_reader("floats", floats);
+  run_floats<no_trim, no_quote>(floats);
+  run_floats<no_trim, double_quote>(floats);
+  run_floats<space_tab_trim, no_quote>(floats);
+  run_floats<space_tab_trim, double_quote>(floats);
+
+  std::string quoted = options.dir + "/bench_quoted.csv";
+  generate_quoted(quoted);
+  measure_line_reader("quoted", quoted);
+  run_quoted<no_trim>(quoted);
+  run_quoted<space_tab_trim>(quoted);
+
+  std::string wide = options.dir + "/bench_wide.csv";
+  generate_wide(wide);
+  measure_line_reader("wide", wide);
+  run_wide<no_trim, no_quote>(wide);
+  run_wide<no_trim, double_quote>(wide);
+  run_wide<space_tab_trim, no_quote>(wide);
+  run_wide<space_tab_trim, double_quote>(wide);
+
+  std::string comments = options.dir + "/bench_comments.csv";
+  generate_comments(comments);
+  measure_line_reader("comments", comments);
+  run_comments<no_trim>(comments);
+  run_comments<space_tab_trim>(comments);
+
+  if (!options.keep_files)
+    for (const std::string &file_name :
+         {ints, floats, quoted, wide, comments})
+      std::remove(file_name.c_str());
+}
@@ -0,0 +1,23 @@
+#!/bin/sh -eu
+# Checks that both benchmarks compile with and without CSV_IO_NO_THREAD, then
+# builds csv_benchmark.cpp in both configurations and runs both.
+# The arguments are passed on to the benchmark. CXX and CXXFLAGS can be set
+# in the environment.
+
+CXX=${CXX:-c++}
+CXXFLAGS=${CXXFLAGS:--O2}
+SRC=$(dirname "$0")
+
+# Both benchmarks must compile in both configurations before anything is
+# run, so that a header that breaks one of them is noticed right away.
+for FILE in csv_benchmark.cpp block_size_benchmark.cpp; do
+  $CXX -std=c++11 $CXXFLAGS -fsyntax-only "$SRC/$FILE"
+  $CXX -std=c++11 $CXXFLAGS -DCSV_IO_NO_THREAD -fsyntax-only "$SRC/$FILE"
+done
+
+$CXX -std=c++11 $CXXFLAGS "$SRC/csv_benchmark.cpp" -o csv_benchmark -lpthread
+$CXX -std=c++11 $CXXFLAGS -DCSV_IO_NO_THREAD "$SRC/csv_benchmark.cpp" \
+  -o csv_benchmark_no_thread
+
+./csv_benchmark "$@"
+./csv_benchmark_no_thread --no-header "$@"
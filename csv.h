@@ -33,22 +33,115 @@
 #define CSV_H
 
 #include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 #ifndef CSV_IO_NO_THREAD
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
+#include <tuple>
 #endif
 #include <cassert>
 #include <cerrno>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
 #include <istream>
 #include <limits>
 #include <memory>
+#include <ostream>
+#if defined(__unix__) || defined(__APPLE__)
+#define CSV_IO_HAS_POSIX_IO
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifndef CSV_IO_NO_MMAP
+#define CSV_IO_HAS_MMAP
+#include <sys/mman.h>
+#endif
+#endif
+#ifdef CSV_IO_USDT
+#include <sys/sdt.h>
+#define CSV_IO_PROBE(name) DTRACE_PROBE(csv_io, name)
+#define CSV_IO_PROBE1(name, a) DTRACE_PROBE1(csv_io, name, a)
+#define CSV_IO_PROBE2(name, a, b) DTRACE_PROBE2(csv_io, name, a, b)
+#else
+#define CSV_IO_PROBE(name)
+#define CSV_IO_PROBE1(name, a)
+#define CSV_IO_PROBE2(name, a, b)
+#endif
+#ifdef CSV_IO_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSV_IO_ZSTD
+#include <zstd.h>
+#endif
+#if defined(__linux__) && !defined(CSV_IO_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CSV_IO_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#if defined(__linux__) && !defined(CSV_IO_NO_INOTIFY) && defined(__has_include)
+#if __has_include(<sys/inotify.h>)
+#define CSV_IO_HAS_INOTIFY
+#include <sys/inotify.h>
+#endif
+#endif
+#if !defined(CSV_IO_NO_SIMD) &&                                              \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CSV_IO_HAS_SSE2
+#include <emmintrin.h>
+#ifdef __AVX2__
+#define CSV_IO_HAS_AVX2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if (__cplusplus >= 201703L ||                                                 \
+     (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)) &&                        \
+    defined(__has_include)
+#if __has_include(<string_view>)
+#define CSV_IO_HAS_STRING_VIEW
+#include <string_view>
+#endif
+#if __has_include(<charconv>)
+#include <charconv>
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define CSV_IO_HAS_TO_CHARS
+#endif
+#endif
+#endif
+
+// The vectorized scanners read whole aligned blocks and therefore
+// intentionally look at the bytes behind the null terminator. Sanitizers
+// must not instrument them.
+#if defined(__clang__)
+#define CSV_IO_NO_SANITIZE                                                     \
+  __attribute__((no_sanitize("address", "memory", "thread")))
+#elif defined(__GNUC__)
+#define CSV_IO_NO_SANITIZE                                                     \
+  __attribute__((no_sanitize_address, no_sanitize_thread))
+#else
+#define CSV_IO_NO_SANITIZE
+#endif
 
 namespace io {
 ////////////////////////////////////////////////////////////////////////////
@@ -115,11 +208,28 @@ struct can_not_open_file : base, with_file_name, with_errno {
   }
 };
 
+struct can_not_read_file : base, with_file_name, with_errno {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  "Can not read file \"%s\" because \"%s\".", file_name,
+                  std::strerror(errno_value));
+  }
+};
+
+struct can_not_seek : base, with_file_name {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  "Can not seek in file \"%s\" because it was not opened by "
+                  "name.",
+                  file_name);
+  }
+};
+
 struct line_length_limit_exceeded : base, with_file_name, with_file_line {
   void format_error_message() const override {
     std::snprintf(
         error_message_buffer, sizeof(error_message_buffer),
-        "Line number %d in file \"%s\" exceeds the maximum length of 2^24-1.",
+        "Line number %d in file \"%s\" exceeds the maximum length.",
         file_line, file_name);
   }
 };
@@ -142,6 +252,8 @@ public:
 
   int read(char *buffer, int size) { return std::fread(buffer, 1, size, file); }
 
+  FILE *get_file() const { return file; }
+
   ~OwningStdIOByteSourceBase() { std::fclose(file); }
 
 private:
@@ -185,880 +297,5898 @@ private:
   long long remaining_byte_count;
 };
 
+// Reads until the buffer is full or the source is exhausted. Byte sources
+// may return less than requested before the end of the input is reached.
+inline int read_fully(ByteSourceBase &byte_source, char *buffer, int size) {
+  int read_byte_count = 0;
+  while (read_byte_count != size) {
+    int n = byte_source.read(buffer + read_byte_count, size - read_byte_count);
+    if (n <= 0)
+      break;
+    read_byte_count += n;
+  }
+  return read_byte_count;
+}
+
 #ifndef CSV_IO_NO_THREAD
-class AsynchronousReader {
+inline void cpu_relax() {
+#ifdef CSV_IO_HAS_SSE2
+  _mm_pause();
+#endif
+}
+
+// Waits until ready() returns true. The waiting thread first spins, then
+// yields and only then parks on the condition variable. The other thread
+// must call wake after making ready() true.
+class SpinThenParkWaiter {
 public:
-  void init(std::unique_ptr<ByteSourceBase> arg_byte_source) {
+  template <class Predicate> void wait(Predicate ready) {
+    for (int i = 0; i < spin_count; ++i) {
+      if (ready())
+        return;
+      cpu_relax();
+    }
+    for (int i = 0; i < yield_count; ++i) {
+      if (ready())
+        return;
+      std::this_thread::yield();
+    }
     std::unique_lock<std::mutex> guard(lock);
+    is_parked.store(true);
+    condition.wait(guard, ready);
+    is_parked.store(false);
+  }
+
+  void wake() {
+    // The sequentially consistent accesses guarantee that either the waiter
+    // sees the new state or that we see that it is parked.
+    if (is_parked.load()) {
+      std::lock_guard<std::mutex> guard(lock);
+      condition.notify_one();
+    }
+  }
+
+  void force_wake() {
+    std::lock_guard<std::mutex> guard(lock);
+    condition.notify_one();
+  }
+
+private:
+  static const int spin_count = 256;
+  static const int yield_count = 16;
+
+  std::mutex lock;
+  std::condition_variable condition;
+  std::atomic<bool> is_parked{false};
+};
+
+// Reads ahead of the parser on a separate thread. The blocks are handed over
+// through a single producer single consumer ring of block_count blocks. The
+// ring positions are atomics and the threads only park when the ring is full
+// or empty for longer than a short spin.
+class AsynchronousReader {
+public:
+  void init(std::unique_ptr<ByteSourceBase> arg_byte_source, int arg_block_len,
+            int arg_block_count) {
     byte_source = std::move(arg_byte_source);
-    desired_byte_count = -1;
-    termination_requested = false;
+    block_len = arg_block_len;
+    block_count = arg_block_count;
+    ring.reset(new char[static_cast<std::size_t>(block_len) * block_count]);
+    read_byte_count.reset(new int[block_count]);
     worker = std::thread([&] {
-      std::unique_lock<std::mutex> guard(lock);
-      try {
-        for (;;) {
-          read_requested_condition.wait(guard, [&] {
-            return desired_byte_count != -1 || termination_requested;
-          });
-          if (termination_requested)
-            return;
+      auto can_write = [&] {
+        return write_position.load() - read_position.load() !=
+                   static_cast<unsigned>(block_count) ||
+               termination_requested.load();
+      };
+      for (unsigned position = 0;; ++position) {
+        producer_waiter.wait(can_write);
+        if (termination_requested.load())
+          return;
 
-          read_byte_count = byte_source->read(buffer, desired_byte_count);
-          desired_byte_count = -1;
-          if (read_byte_count == 0)
-            break;
-          read_finished_condition.notify_one();
+        int slot = position % block_count;
+        int byte_count;
+        try {
+          byte_count = read_fully(*byte_source, block(slot), block_len);
+        } catch (...) {
+          read_error = std::current_exception();
+          byte_count = -1;
         }
-      } catch (...) {
-        read_error = std::current_exception();
+        read_byte_count[slot] = byte_count;
+        write_position.store(position + 1);
+        consumer_waiter.wake();
+        if (byte_count != block_len)
+          return;
       }
-      read_finished_condition.notify_one();
     });
   }
 
   bool is_valid() const { return byte_source != nullptr; }
 
-  void start_read(char *arg_buffer, int arg_desired_byte_count) {
-    std::unique_lock<std::mutex> guard(lock);
-    buffer = arg_buffer;
-    desired_byte_count = arg_desired_byte_count;
-    read_byte_count = -1;
-    read_requested_condition.notify_one();
-  }
-
-  int finish_read() {
-    std::unique_lock<std::mutex> guard(lock);
-    read_finished_condition.wait(
-        guard, [&] { return read_byte_count != -1 || read_error; });
-    if (read_error)
+  // Copies the next block into buffer and returns its size. Returns less than
+  // block_len only at the end of the input.
+  int read_block(char *buffer) {
+    if (is_at_end_of_input)
+      return 0;
+    unsigned position = read_position.load(std::memory_order_relaxed);
+    consumer_waiter.wait([&] { return write_position.load() != position; });
+
+    int slot = position % block_count;
+    int byte_count = read_byte_count[slot];
+    if (byte_count == -1) {
+      is_at_end_of_input = true;
       std::rethrow_exception(read_error);
-    else
-      return read_byte_count;
+    }
+    std::memcpy(buffer, block(slot), byte_count);
+    if (byte_count != block_len)
+      is_at_end_of_input = true;
+
+    read_position.store(position + 1);
+    producer_waiter.wake();
+    return byte_count;
   }
 
-  ~AsynchronousReader() {
+  // Stops the reading thread. Afterwards init may be called again.
+  void close() {
     if (byte_source != nullptr) {
-      {
-        std::unique_lock<std::mutex> guard(lock);
-        termination_requested = true;
-      }
-      read_requested_condition.notify_one();
+      termination_requested.store(true);
+      producer_waiter.force_wake();
       worker.join();
+      byte_source.reset();
     }
+    read_error = nullptr;
+    write_position.store(0);
+    read_position.store(0);
+    termination_requested.store(false);
+    is_at_end_of_input = false;
   }
 
+  ~AsynchronousReader() { close(); }
+
 private:
+  char *block(int slot) {
+    return ring.get() + static_cast<std::size_t>(slot) * block_len;
+  }
+
   std::unique_ptr<ByteSourceBase> byte_source;
 
   std::thread worker;
 
-  bool termination_requested;
+  int block_len;
+  int block_count;
+  std::unique_ptr<char[]> ring;
+  std::unique_ptr<int[]> read_byte_count; // -1 signals read_error
   std::exception_ptr read_error;
-  char *buffer;
-  int desired_byte_count;
-  int read_byte_count;
 
-  std::mutex lock;
-  std::condition_variable read_finished_condition;
-  std::condition_variable read_requested_condition;
+  // Number of blocks written by the worker and read by the parser. Only the
+  // respective thread writes its position.
+  std::atomic<unsigned> write_position{0};
+  std::atomic<unsigned> read_position{0};
+  std::atomic<bool> termination_requested{false};
+  bool is_at_end_of_input = false;
+
+  SpinThenParkWaiter producer_waiter;
+  SpinThenParkWaiter consumer_waiter;
 };
 #endif
 
+// Reads on demand in the calling thread.
 class SynchronousReader {
 public:
-  void init(std::unique_ptr<ByteSourceBase> arg_byte_source) {
+  void init(std::unique_ptr<ByteSourceBase> arg_byte_source, int arg_block_len,
+            int) {
     byte_source = std::move(arg_byte_source);
+    block_len = arg_block_len;
   }
 
   bool is_valid() const { return byte_source != nullptr; }
 
-  void start_read(char *arg_buffer, int arg_desired_byte_count) {
-    buffer = arg_buffer;
-    desired_byte_count = arg_desired_byte_count;
+  int read_block(char *buffer) {
+    return read_fully(*byte_source, buffer, block_len);
   }
 
-  int finish_read() { return byte_source->read(buffer, desired_byte_count); }
+  void close() { byte_source.reset(); }
 
 private:
   std::unique_ptr<ByteSourceBase> byte_source;
-  char *buffer;
-  int desired_byte_count;
+  int block_len;
 };
-} // namespace detail
 
-class LineReader {
-private:
-  static const int block_len = 1 << 20;
-  std::unique_ptr<char[]> buffer; // must be constructed before (and thus
-                                  // destructed after) the reader!
-#ifdef CSV_IO_NO_THREAD
-  detail::SynchronousReader reader;
+inline std::unique_ptr<ByteSourceBase> open_file(const char *file_name) {
+  // We open the file in binary mode as it makes no difference under *nix
+  // and under Windows we handle \r\n newlines ourself.
+  FILE *file = std::fopen(file_name, "rb");
+  if (file == 0) {
+    int x = errno; // store errno as soon as possible, doing it after
+                   // constructor call can fail.
+    error::can_not_open_file err;
+    err.set_errno(x);
+    err.set_file_name(file_name);
+    throw err;
+  }
+  return std::unique_ptr<ByteSourceBase>(new OwningStdIOByteSourceBase(file));
+}
+
+// fseek and ftell with 64 bit offsets, as long has only 32 bits on Windows.
+inline int seek_file(FILE *file, long long byte_offset, int origin) {
+#if defined(_WIN32)
+  return _fseeki64(file, byte_offset, origin);
+#elif defined(CSV_IO_HAS_POSIX_IO)
+  return fseeko(file, static_cast<off_t>(byte_offset), origin);
 #else
-  detail::AsynchronousReader reader;
+  return std::fseek(file, static_cast<long>(byte_offset), origin);
 #endif
-  int data_begin;
-  int data_end;
+}
 
-  char file_name[error::max_file_name_length + 1];
-  unsigned file_line;
+inline long long tell_file(FILE *file) {
+#if defined(_WIN32)
+  return _ftelli64(file);
+#elif defined(CSV_IO_HAS_POSIX_IO)
+  return ftello(file);
+#else
+  return std::ftell(file);
+#endif
+}
 
-  static std::unique_ptr<ByteSourceBase> open_file(const char *file_name) {
-    // We open the file in binary mode as it makes no difference under *nix
-    // and under Windows we handle \r\n newlines ourself.
-    FILE *file = std::fopen(file_name, "rb");
-    if (file == 0) {
-      int x = errno; // store errno as soon as possible, doing it after
-                     // constructor call can fail.
-      error::can_not_open_file err;
-      err.set_errno(x);
-      err.set_file_name(file_name);
-      throw err;
+// Opens the file and moves to byte_offset.
+inline std::unique_ptr<ByteSourceBase> open_file_at(const char *file_name,
+                                                    long long byte_offset) {
+  std::unique_ptr<ByteSourceBase> byte_source = open_file(file_name);
+  FILE *file = static_cast<OwningStdIOByteSourceBase &>(*byte_source).get_file();
+  int result = seek_file(file, byte_offset, SEEK_SET);
+  if (result != 0) {
+    int x = errno;
+    error::can_not_read_file err;
+    err.set_errno(x);
+    err.set_file_name(file_name);
+    throw err;
+  }
+  return byte_source;
+}
+
+#ifdef CSV_IO_HAS_MMAP
+class MemoryMappedFile {
+public:
+  MemoryMappedFile() : data(nullptr), size(0) {}
+  MemoryMappedFile(const MemoryMappedFile &) = delete;
+  MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+  // Returns nullptr if the file was mapped. Pipes and character devices
+  // cannot be mapped, and files in /proc report a size of 0 although they
+  // are not empty. Such files, and empty files, are returned opened as a
+  // FILE, so that they can be read in the usual way without opening them a
+  // second time.
+  std::FILE *open(const char *file_name) {
+    int fd = ::open(file_name, O_RDONLY);
+    if (fd == -1)
+      throw_can_not_open_file(file_name, errno);
+    struct stat file_info;
+    if (::fstat(fd, &file_info) == -1) {
+      int x = errno;
+      ::close(fd);
+      throw_can_not_open_file(file_name, x);
     }
-    return std::unique_ptr<ByteSourceBase>(
-        new detail::OwningStdIOByteSourceBase(file));
+    if (!S_ISREG(file_info.st_mode) || file_info.st_size == 0) {
+      std::FILE *file = ::fdopen(fd, "rb");
+      if (file == nullptr) {
+        int x = errno;
+        ::close(fd);
+        throw_can_not_open_file(file_name, x);
+      }
+      return file;
+    }
+    size = static_cast<std::size_t>(file_info.st_size);
+    released_byte_count = 0;
+    // The mapping is read-only, so its pages stay in the page cache and are
+    // never copied into anonymous memory.
+    void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      int x = errno;
+      ::close(fd);
+      throw_can_not_open_file(file_name, x);
+    }
+    data = static_cast<char *>(mapping);
+    // These are only hints. It does not matter whether the kernel follows
+    // them.
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    ::madvise(mapping, size, MADV_HUGEPAGE);
+#endif
+    ::close(fd);
+    return nullptr;
   }
 
-  void init(std::unique_ptr<ByteSourceBase> byte_source) {
-    file_line = 0;
+  const char *begin() const { return data; }
+  const char *end() const { return data + size; }
+
+  // Tells the kernel that the pages in front of p are not needed anymore,
+  // so that reading a large file does not keep all of it resident. Pages
+  // that are accessed again are read from the file again. The pages are
+  // released in steps of release_step bytes.
+  void release_before(const char *p) {
+    std::size_t n = static_cast<std::size_t>(p - data);
+    if (n < released_byte_count + release_step)
+      return;
+    n -= n % get_page_size();
+    ::madvise(data + released_byte_count, n - released_byte_count,
+              MADV_DONTNEED);
+    released_byte_count = n;
+  }
 
-    buffer = std::unique_ptr<char[]>(new char[3 * block_len]);
-    data_begin = 0;
-    data_end = byte_source->read(buffer.get(), 2 * block_len);
+  // Called after seeking to p. The pages in front of p that are accessed
+  // again after a seek are released the next time release_before passes
+  // them.
+  void restart_release_at(const char *p) {
+    std::size_t n = static_cast<std::size_t>(p - data);
+    released_byte_count = n - n % get_page_size();
+  }
 
-    // Ignore UTF-8 BOM
-    if (data_end >= 3 && buffer[0] == '\xEF' && buffer[1] == '\xBB' &&
-        buffer[2] == '\xBF')
-      data_begin = 3;
+  void close() {
+    if (data != nullptr)
+      ::munmap(data, size);
+    data = nullptr;
+    size = 0;
+  }
 
-    if (data_end == 2 * block_len) {
-      reader.init(std::move(byte_source));
-      reader.start_read(buffer.get() + 2 * block_len, block_len);
-    }
+  ~MemoryMappedFile() { close(); }
+
+private:
+  static void throw_can_not_open_file(const char *file_name, int x) {
+    error::can_not_open_file err;
+    err.set_errno(x);
+    err.set_file_name(file_name);
+    throw err;
+  }
+
+  static std::size_t get_page_size() {
+    static const std::size_t page_size =
+        static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return page_size;
   }
 
+  static const std::size_t release_step = 16 << 20;
+
+  char *data;
+  std::size_t size;
+  std::size_t released_byte_count;
+};
+#endif
+#ifdef CSV_IO_HAS_IO_URING
+// A minimal io_uring wrapper on top of the raw system calls, so that
+// liburing is not needed.
+class IoUring {
 public:
-  LineReader() = delete;
-  LineReader(const LineReader &) = delete;
-  LineReader &operator=(const LineReader &) = delete;
+  IoUring() = default;
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  // Returns false if the kernel does not support io_uring or if it has been
+  // disabled, for example by a seccomp filter.
+  bool init(unsigned entry_count) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, entry_count, &params));
+    if (ring_fd < 0)
+      return false;
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool is_single_mapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (is_single_mapping)
+      sq_ring_size = cq_ring_size = (std::max)(sq_ring_size, cq_ring_size);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    sq_ring = map(sq_ring_size, IORING_OFF_SQ_RING);
+    cq_ring = is_single_mapping ? sq_ring : map(cq_ring_size, IORING_OFF_CQ_RING);
+    sqes = static_cast<io_uring_sqe *>(map(sqes_size, IORING_OFF_SQES));
+    if (sq_ring == nullptr || cq_ring == nullptr || sqes == nullptr) {
+      release();
+      return false;
+    }
 
-  explicit LineReader(const char *file_name) {
-    set_file_name(file_name);
-    init(open_file(file_name));
+    char *sq = static_cast<char *>(sq_ring);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(cq_ring);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
   }
 
-  explicit LineReader(const std::string &file_name) {
-    set_file_name(file_name.c_str());
-    init(open_file(file_name.c_str()));
+  // Returns 0 or an errno value.
+  int submit_read(int fd, iovec *target, long long offset,
+                  unsigned long long user_data) {
+    unsigned tail = *sq_tail;
+    unsigned index = tail & sq_mask;
+    io_uring_sqe &sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<unsigned long long>(target);
+    sqe.len = 1;
+    sqe.off = offset;
+    sqe.user_data = user_data;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return enter(1, 0, 0);
   }
 
-  LineReader(const char *file_name,
-             std::unique_ptr<ByteSourceBase> byte_source) {
-    set_file_name(file_name);
-    init(std::move(byte_source));
+  // Asks the kernel to cancel the request with target_user_data. The
+  // cancellation itself completes with user_data. Returns 0 or an errno
+  // value.
+  int submit_cancel(unsigned long long target_user_data,
+                    unsigned long long user_data) {
+    unsigned tail = *sq_tail;
+    unsigned index = tail & sq_mask;
+    io_uring_sqe &sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.fd = -1;
+    sqe.addr = target_user_data;
+    sqe.user_data = user_data;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return enter(1, 0, 0);
   }
 
-  LineReader(const std::string &file_name,
-             std::unique_ptr<ByteSourceBase> byte_source) {
-    set_file_name(file_name.c_str());
-    init(std::move(byte_source));
+  // Blocks until a request has finished. Returns 0 or an errno value.
+  int wait_for_completion(unsigned long long &user_data, int &result) {
+    for (;;) {
+      unsigned head = *cq_head;
+      if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe &cqe = cqes[head & cq_mask];
+        user_data = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        return 0;
+      }
+      if (int x = enter(0, 1, IORING_ENTER_GETEVENTS))
+        return x;
+    }
   }
 
-  LineReader(const char *file_name, const char *data_begin,
-             const char *data_end) {
-    set_file_name(file_name);
-    init(std::unique_ptr<ByteSourceBase>(new detail::NonOwningStringByteSource(
-        data_begin, data_end - data_begin)));
+  void release() {
+    if (sqes != nullptr)
+      ::munmap(sqes, sqes_size);
+    if (cq_ring != nullptr && cq_ring != sq_ring)
+      ::munmap(cq_ring, cq_ring_size);
+    if (sq_ring != nullptr)
+      ::munmap(sq_ring, sq_ring_size);
+    if (ring_fd >= 0)
+      ::close(ring_fd);
+    sqes = nullptr;
+    sq_ring = cq_ring = nullptr;
+    ring_fd = -1;
   }
 
-  LineReader(const std::string &file_name, const char *data_begin,
-             const char *data_end) {
-    set_file_name(file_name.c_str());
-    init(std::unique_ptr<ByteSourceBase>(new detail::NonOwningStringByteSource(
-        data_begin, data_end - data_begin)));
+  ~IoUring() { release(); }
+
+private:
+  void *map(std::size_t size, long long offset) {
+    void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+    return p == MAP_FAILED ? nullptr : p;
   }
 
-  LineReader(const char *file_name, FILE *file) {
-    set_file_name(file_name);
-    init(std::unique_ptr<ByteSourceBase>(
-        new detail::OwningStdIOByteSourceBase(file)));
+  int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    while (::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                     flags, nullptr, 0) < 0) {
+      if (errno != EINTR)
+        return errno;
+    }
+    return 0;
   }
 
-  LineReader(const std::string &file_name, FILE *file) {
-    set_file_name(file_name.c_str());
-    init(std::unique_ptr<ByteSourceBase>(
-        new detail::OwningStdIOByteSourceBase(file)));
+  int ring_fd = -1;
+  void *sq_ring = nullptr;
+  void *cq_ring = nullptr;
+  io_uring_sqe *sqes = nullptr;
+  std::size_t sq_ring_size, cq_ring_size, sqes_size;
+
+  unsigned *sq_tail, *sq_array, sq_mask;
+  unsigned *cq_head, *cq_tail, cq_mask;
+  io_uring_cqe *cqes;
+};
+#endif
+} // namespace detail
+
+#ifdef CSV_IO_HAS_POSIX_IO
+// Reads a file through a raw file descriptor instead of a FILE*. The kernel
+// is told that the file is read sequentially. On Linux up to queue_depth
+// aligned reads of read_size bytes are kept in flight using io_uring. If
+// io_uring is not available, the reads are done one at a time using pread.
+// use_direct_io opens the file with O_DIRECT, which bypasses the page cache.
+// File systems that do not support O_DIRECT are read normally.
+class FileDescriptorByteSource : public ByteSourceBase {
+public:
+  FileDescriptorByteSource(const FileDescriptorByteSource &) = delete;
+  FileDescriptorByteSource &
+  operator=(const FileDescriptorByteSource &) = delete;
+
+  explicit FileDescriptorByteSource(const char *file_name,
+                                    bool use_direct_io = false,
+                                    int queue_depth = 4,
+                                    int read_size = 1 << 20) {
+    open(file_name, use_direct_io, queue_depth, read_size);
   }
 
-  LineReader(const char *file_name, std::istream &in) {
-    set_file_name(file_name);
-    init(std::unique_ptr<ByteSourceBase>(
-        new detail::NonOwningIStreamByteSource(in)));
+  explicit FileDescriptorByteSource(const std::string &file_name,
+                                    bool use_direct_io = false,
+                                    int queue_depth = 4,
+                                    int read_size = 1 << 20) {
+    open(file_name.c_str(), use_direct_io, queue_depth, read_size);
   }
 
-  LineReader(const std::string &file_name, std::istream &in) {
-    set_file_name(file_name.c_str());
-    init(std::unique_ptr<ByteSourceBase>(
-        new detail::NonOwningIStreamByteSource(in)));
+  int read(char *buffer, int size) override {
+    if (requests == nullptr)
+      return read_unstaged(buffer, size);
+
+    if (is_at_end_of_input)
+      return 0;
+
+    Request &r = requests[current_request];
+    if (!r.is_finished)
+      wait_for(r);
+    if (r.error != 0) {
+      is_at_end_of_input = true;
+      throw_can_not_read_file(r.error);
+    }
+
+    int n = (std::min)(size, r.byte_count - consumed_byte_count);
+    std::memcpy(buffer, r.data + consumed_byte_count, n);
+    consumed_byte_count += n;
+    if (consumed_byte_count == r.byte_count) {
+      if (r.byte_count != read_size) {
+        is_at_end_of_input = true;
+      } else {
+        consumed_byte_count = 0;
+        submit(r);
+        current_request = (current_request + 1) % request_count;
+      }
+    }
+    return n;
   }
 
-  void set_file_name(const std::string &file_name) {
-    set_file_name(file_name.c_str());
+  ~FileDescriptorByteSource() {
+#ifdef CSV_IO_HAS_IO_URING
+    // The kernel may still write into the staging buffers. The reads in
+    // flight are cancelled and their completions awaited before the buffers
+    // are freed. If waiting fails, the buffers are leaked rather than freed
+    // under the kernel's feet. Closing the ring then ends the reads.
+    if (is_using_io_uring) {
+      for (int i = 0; i < request_count; ++i)
+        if (!requests[i].is_finished)
+          ring.submit_cancel(i, cancel_user_data);
+      for (int i = 0; i < request_count && staging != nullptr; ++i)
+        while (!requests[i].is_finished) {
+          unsigned long long user_data;
+          int result;
+          if (ring.wait_for_completion(user_data, result) != 0) {
+            staging = nullptr;
+            break;
+          }
+          if (user_data != cancel_user_data)
+            requests[user_data].is_finished = true;
+        }
+    }
+#endif
+    std::free(staging);
+    ::close(fd);
   }
 
-  void set_file_name(const char *file_name) {
+private:
+  // O_DIRECT requires the buffers, the offsets and the sizes to be aligned to
+  // the logical block size of the device, which is at most this.
+  static const int alignment = 4096;
+
+#ifdef CSV_IO_HAS_IO_URING
+  // Reads complete with the index of their request, cancellations with this.
+  static const unsigned long long cancel_user_data = ~0ULL;
+#endif
+
+  struct Request {
+    char *data;
+    long long offset;
+    int byte_count;
+    int error;
+    bool is_finished;
+#ifdef CSV_IO_HAS_IO_URING
+    iovec target;
+#endif
+  };
+
+  void open(const char *file_name, bool use_direct_io, int queue_depth,
+            int read_size) {
     if (file_name != nullptr) {
       strncpy(this->file_name, file_name, sizeof(this->file_name) - 1);
       this->file_name[sizeof(this->file_name) - 1] = '\0';
     } else {
       this->file_name[0] = '\0';
     }
-  }
-
-  const char *get_truncated_file_name() const { return file_name; }
 
-  void set_file_line(unsigned file_line) { this->file_line = file_line; }
+    int flags = O_RDONLY;
+#ifdef O_CLOEXEC
+    flags |= O_CLOEXEC;
+#endif
+#ifdef O_DIRECT
+    if (use_direct_io) {
+      fd = ::open(file_name, flags | O_DIRECT);
+      if (fd == -1 && errno != EINVAL)
+        throw_can_not_open_file(errno);
+      is_direct = fd != -1;
+    }
+#else
+    (void)use_direct_io;
+#endif
+    if (fd == -1)
+      fd = ::open(file_name, flags);
+    if (fd == -1)
+      throw_can_not_open_file(errno);
+
+    struct stat file_info;
+    if (::fstat(fd, &file_info) == -1) {
+      int x = errno;
+      ::close(fd);
+      throw_can_not_open_file(x);
+    }
+    is_seekable = S_ISREG(file_info.st_mode);
+#ifdef O_DIRECT
+    // O_DIRECT puts pipes into packet mode.
+    if (is_direct && !is_seekable) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT);
+      is_direct = false;
+    }
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (is_seekable)
+      ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 
-  unsigned get_file_line() const { return file_line; }
+    if (queue_depth < 1)
+      queue_depth = 1;
+    this->read_size = (std::max)(read_size, 1);
+    this->read_size = (this->read_size + alignment - 1) / alignment * alignment;
+
+    bool is_staged = is_direct;
+#ifdef CSV_IO_HAS_IO_URING
+    is_using_io_uring = is_seekable && ring.init(queue_depth);
+    if (is_using_io_uring) {
+      request_count = queue_depth;
+      is_staged = true;
+    }
+#endif
+    if (!is_staged)
+      return;
+
+    void *p;
+    if (::posix_memalign(&p, alignment,
+                         static_cast<std::size_t>(this->read_size) *
+                             request_count) != 0) {
+      ::close(fd);
+      throw std::bad_alloc();
+    }
+    staging = static_cast<char *>(p);
+    requests.reset(new Request[request_count]);
+    for (int i = 0; i < request_count; ++i) {
+      requests[i].data = staging + static_cast<std::size_t>(i) * this->read_size;
+      requests[i].is_finished = true;
+    }
+    for (int i = 0; i < request_count; ++i)
+      submit(requests[i]);
+  }
 
-  char *next_line() {
-    if (data_begin == data_end)
-      return nullptr;
+  int read_unstaged(char *buffer, int size) {
+    for (;;) {
+      ssize_t n = is_seekable ? ::pread(fd, buffer, size, next_offset)
+                              : ::read(fd, buffer, size);
+      if (n >= 0) {
+        next_offset += n;
+        return static_cast<int>(n);
+      }
+      if (errno != EINTR)
+        throw_can_not_read_file(errno);
+    }
+  }
 
-    ++file_line;
+  void submit(Request &r) {
+    r.offset = next_offset;
+    next_offset += read_size;
+    r.byte_count = 0;
+    r.error = 0;
+    r.is_finished = false;
+#ifdef CSV_IO_HAS_IO_URING
+    if (is_using_io_uring)
+      submit_remainder(r);
+#endif
+  }
 
-    assert(data_begin < data_end);
-    assert(data_end <= block_len * 2);
+  // Returns true if r is complete after result bytes were added.
+  bool add_read_result(Request &r, long long result) {
+    if (result == 0)
+      return true;
+    r.byte_count += static_cast<int>(result);
+    // Direct reads only return less than an aligned size at the end of the
+    // file.
+    return r.byte_count == read_size || (is_direct && result % alignment != 0);
+  }
 
-    if (data_begin >= block_len) {
-      std::memcpy(buffer.get(), buffer.get() + block_len, block_len);
-      data_begin -= block_len;
-      data_end -= block_len;
-      if (reader.is_valid()) {
-        data_end += reader.finish_read();
-        std::memcpy(buffer.get() + block_len, buffer.get() + 2 * block_len,
-                    block_len);
-        reader.start_read(buffer.get() + 2 * block_len, block_len);
+  void wait_for(Request &r) {
+#ifdef CSV_IO_HAS_IO_URING
+    if (is_using_io_uring) {
+      while (!r.is_finished) {
+        unsigned long long user_data;
+        int result;
+        if (int x = ring.wait_for_completion(user_data, result))
+          throw_can_not_read_file(x);
+        Request &finished = requests[user_data];
+        if (result == -EINTR || result == -EAGAIN)
+          submit_remainder(finished);
+        else if (result < 0)
+          finish(finished, -result);
+        else if (add_read_result(finished, result))
+          finish(finished, 0);
+        else
+          submit_remainder(finished);
       }
+      return;
     }
-
-    int line_end = data_begin;
-    while (line_end != data_end && buffer[line_end] != '\n') {
-      ++line_end;
+#endif
+    // Without io_uring the read is only done when the data is needed.
+    for (;;) {
+      ssize_t n = ::pread(fd, r.data + r.byte_count, read_size - r.byte_count,
+                          r.offset + r.byte_count);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return finish(r, errno);
+      }
+      if (add_read_result(r, n))
+        return finish(r, 0);
     }
+  }
 
-    if (line_end - data_begin + 1 > block_len) {
-      error::line_length_limit_exceeded err;
-      err.set_file_name(file_name);
-      err.set_file_line(file_line);
-      throw err;
-    }
+  void finish(Request &r, int error) {
+    r.error = error;
+    r.is_finished = true;
+  }
 
-    if (line_end != data_end && buffer[line_end] == '\n') {
-      buffer[line_end] = '\0';
-    } else {
-      // some files are missing the newline at the end of the
-      // last line
-      ++data_end;
-      buffer[line_end] = '\0';
-    }
+#ifdef CSV_IO_HAS_IO_URING
+  void submit_remainder(Request &r) {
+    r.target.iov_base = r.data + r.byte_count;
+    r.target.iov_len = read_size - r.byte_count;
+    if (int x = ring.submit_read(fd, &r.target, r.offset + r.byte_count,
+                                 &r - requests.get()))
+      finish(r, x);
+  }
+#endif
 
-    // handle windows \r\n-line breaks
-    if (line_end != data_begin && buffer[line_end - 1] == '\r')
-      buffer[line_end - 1] = '\0';
+  void throw_can_not_open_file(int x) const {
+    error::can_not_open_file err;
+    err.set_errno(x);
+    err.set_file_name(file_name);
+    throw err;
+  }
 
-    char *ret = buffer.get() + data_begin;
-    data_begin = line_end + 1;
-    return ret;
+  void throw_can_not_read_file(int x) const {
+    error::can_not_read_file err;
+    err.set_errno(x);
+    err.set_file_name(file_name);
+    throw err;
   }
+
+  char file_name[error::max_file_name_length + 1];
+  int fd = -1;
+  bool is_seekable;
+  bool is_direct = false;
+  int read_size;
+  long long next_offset = 0;
+
+  // Only used if the reads go through the aligned staging buffers.
+  char *staging = nullptr;
+  std::unique_ptr<Request[]> requests;
+  int request_count = 1;
+  int current_request = 0;
+  int consumed_byte_count = 0;
+  bool is_at_end_of_input = false;
+
+#ifdef CSV_IO_HAS_IO_URING
+  bool is_using_io_uring = false;
+  detail::IoUring ring;
+#endif
 };
 
-////////////////////////////////////////////////////////////////////////////
-//                                 CSV                                    //
-////////////////////////////////////////////////////////////////////////////
+namespace detail {
+// A file that another process appends to. read returns 0 if there is
+// currently nothing more to read, and wait blocks until the file changes.
+// Without inotify, wait checks the size of the file every millisecond.
+class FollowedFile {
+public:
+  FollowedFile() {}
+  FollowedFile(const FollowedFile &) = delete;
+  FollowedFile &operator=(const FollowedFile &) = delete;
 
-namespace error {
-const int max_column_name_length = 63;
-struct with_column_name {
-  with_column_name() {
-    std::memset(column_name, 0, max_column_name_length + 1);
-  }
-
-  void set_column_name(const char *column_name) {
-    if (column_name != nullptr) {
-      std::strncpy(this->column_name, column_name, max_column_name_length);
-      this->column_name[max_column_name_length] = '\0';
+  void open(const char *file_name) {
+    if (file_name != nullptr) {
+      std::strncpy(this->file_name, file_name, sizeof(this->file_name));
+      this->file_name[sizeof(this->file_name) - 1] = '\0';
     } else {
-      this->column_name[0] = '\0';
+      this->file_name[0] = '\0';
+    }
+
+    int flags = O_RDONLY;
+#ifdef O_CLOEXEC
+    flags |= O_CLOEXEC;
+#endif
+    fd = ::open(file_name, flags);
+    if (fd == -1) {
+      int x = errno;
+      error::can_not_open_file err;
+      err.set_errno(x);
+      err.set_file_name(file_name);
+      throw err;
+    }
+#ifdef CSV_IO_HAS_INOTIFY
+    // If the watch can not be set up, for example because the limit of
+    // watches is reached, the size is polled instead.
+    inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd != -1 &&
+        ::inotify_add_watch(inotify_fd, file_name, IN_MODIFY) == -1) {
+      ::close(inotify_fd);
+      inotify_fd = -1;
     }
+#endif
   }
 
-  char column_name[max_column_name_length + 1];
-};
+  void seek(long long offset) { next_offset = offset; }
 
-const int max_column_content_length = 63;
+  int read(char *buffer, int size) {
+    for (;;) {
+      ssize_t n = ::pread(fd, buffer, size, next_offset);
+      if (n >= 0) {
+        next_offset += n;
+        return static_cast<int>(n);
+      }
+      if (errno != EINTR) {
+        int x = errno;
+        error::can_not_read_file err;
+        err.set_errno(x);
+        err.set_file_name(file_name);
+        throw err;
+      }
+    }
+  }
 
-struct with_column_content {
-  with_column_content() {
-    std::memset(column_content, 0, max_column_content_length + 1);
+  static long long get_milliseconds() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
   }
 
-  void set_column_content(const char *column_content) {
-    if (column_content != nullptr) {
-      std::strncpy(this->column_content, column_content,
-                   max_column_content_length);
-      this->column_content[max_column_content_length] = '\0';
-    } else {
-      this->column_content[0] = '\0';
+  // Returns false if nothing changed within timeout_milliseconds. A negative
+  // timeout waits forever. A change does not guarantee that there are new
+  // bytes.
+  bool wait(int timeout_milliseconds) {
+#ifdef CSV_IO_HAS_INOTIFY
+    if (inotify_fd != -1) {
+      pollfd p;
+      p.fd = inotify_fd;
+      p.events = POLLIN;
+      p.revents = 0;
+      int result;
+      do
+        result = ::poll(&p, 1, timeout_milliseconds);
+      while (result == -1 && errno == EINTR);
+      if (result <= 0)
+        return false;
+      // The events only wake us up. Afterwards read tells whether the file
+      // has grown.
+      alignas(inotify_event) char events[4096];
+      while (::read(inotify_fd, events, sizeof(events)) > 0) {
+      }
+      return true;
     }
+#endif
+    for (int waited = 0;
+         timeout_milliseconds < 0 || waited < timeout_milliseconds;
+         ++waited) {
+      ::poll(nullptr, 0, 1);
+      struct stat file_info;
+      if (::fstat(fd, &file_info) == 0 && file_info.st_size > next_offset)
+        return true;
+    }
+    return false;
   }
 
-  char column_content[max_column_content_length + 1];
-};
-
-struct extra_column_in_header : base, with_file_name, with_column_name {
-  void format_error_message() const override {
-    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
-                  R"(Extra column "%s" in header of file "%s".)", column_name,
-                  file_name);
+  ~FollowedFile() {
+#ifdef CSV_IO_HAS_INOTIFY
+    if (inotify_fd != -1)
+      ::close(inotify_fd);
+#endif
+    if (fd != -1)
+      ::close(fd);
   }
-};
 
-struct missing_column_in_header : base, with_file_name, with_column_name {
-  void format_error_message() const override {
-    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
-                  R"(Missing column "%s" in header of file "%s".)", column_name,
-                  file_name);
-  }
+private:
+  char file_name[error::max_file_name_length + 1];
+  int fd = -1;
+  long long next_offset = 0;
+#ifdef CSV_IO_HAS_INOTIFY
+  int inotify_fd = -1;
+#endif
 };
+} // namespace detail
+#endif
 
-struct duplicated_column_in_header : base, with_file_name, with_column_name {
-  void format_error_message() const override {
-    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
-                  R"(Duplicated column "%s" in header of file "%s".)",
-                  column_name, file_name);
+#ifdef CSV_IO_STATISTICS
+struct line_reader_statistics {
+  // Bytes of the input that have been returned by next_line, including
+  // newlines.
+  long long consumed_byte_count = 0;
+  // The size of the input, or -1 if it is not known, as for streams and
+  // user defined byte sources.
+  long long total_byte_count = -1;
+  long long line_count = 0;
+  // Time next_line spent waiting for the byte source. With prefetching this
+  // is only the time in which the parser was faster than the reader.
+  long long io_wait_nanoseconds = 0;
+
+  // Returns a value between 0 and 1, or -1 if the size is not known.
+  double get_progress() const {
+    if (total_byte_count < 0)
+      return -1;
+    if (total_byte_count == 0)
+      return 1;
+    return static_cast<double>(consumed_byte_count) / total_byte_count;
   }
 };
 
-struct header_missing : base, with_file_name {
-  void format_error_message() const override {
-    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
-                  "Header missing in file \"%s\".", file_name);
-  }
-};
+namespace detail {
+inline long long get_nanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
 
-struct too_few_columns : base, with_file_name, with_file_line {
-  void format_error_message() const override {
-    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
-                  "Too few columns in line %d in file \"%s\".", file_line,
-                  file_name);
-  }
-};
+inline long long get_file_size(const char *file_name) {
+  std::FILE *file = std::fopen(file_name, "rb");
+  if (file == nullptr)
+    return -1;
+  long long size = -1;
+  if (seek_file(file, 0, SEEK_END) == 0)
+    size = tell_file(file);
+  std::fclose(file);
+  return size;
+}
 
-struct too_many_columns : base, with_file_name, with_file_line {
-  void format_error_message() const override {
-    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
-                  "Too many columns in line %d in file \"%s\".", file_line,
-                  file_name);
-  }
-};
+// Returns the number of bytes between the position of file and its end.
+inline long long get_remaining_file_size(std::FILE *file) {
+  long long position = tell_file(file);
+  if (position < 0 || seek_file(file, 0, SEEK_END) != 0)
+    return -1;
+  long long end = tell_file(file);
+  seek_file(file, position, SEEK_SET);
+  return end < 0 ? -1 : end - position;
+}
+} // namespace detail
+#endif
 
-struct escaped_string_not_closed : base, with_file_name, with_file_line {
-  void format_error_message() const override {
-    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
-                  "Escaped string was not closed in line %d in file \"%s\".",
-                  file_line, file_name);
-  }
+// Pass direct_io as last argument to the LineReader or CSVReader constructor
+// to read the file using a FileDescriptorByteSource with O_DIRECT. On other
+// platforms the file is read in the usual way.
+struct direct_io_t {};
+static const direct_io_t direct_io = direct_io_t();
+
+// Pass memory_map as last argument to the LineReader or CSVReader
+// constructor to read the file out of a read-only memory mapping instead of
+// copying it block by block. Only the current line is copied. On platforms
+// without mmap the file is read in the usual way.
+struct memory_map_t {};
+static const memory_map_t memory_map = memory_map_t();
+
+// Pass follow as last argument to the LineReader or CSVReader constructor to
+// follow a file that is still being appended to. Instead of stopping at the
+// end of the file the reader waits until a complete line was appended. On
+// platforms without POSIX I/O the file is read in the usual way.
+struct follow_t {};
+static const follow_t follow = follow_t();
+
+// The block policy determines the size of the blocks in which the input is
+// read and how many blocks a separate thread reads ahead. A LineReader holds
+// 2+prefetch_block_count blocks of memory. Without prefetching no thread is
+// started and the parser reads the blocks itself.
+template <int block_byte_count, int prefetch_block_count = 1>
+struct block_size {
+  static_assert(block_byte_count >= 1, "block size must be positive");
+  static_assert(block_byte_count <= (1 << 29),
+                "two blocks must be addressable using an int");
+  static_assert(prefetch_block_count >= 0,
+                "prefetch block count must not be negative");
+  static const int block_len = block_byte_count;
+  static const int prefetch_count = prefetch_block_count;
 };
 
-struct integer_must_be_positive : base,
-                                  with_file_name,
-                                  with_file_line,
-                                  with_column_name,
-                                  with_column_content {
-  void format_error_message() const override {
-    std::snprintf(
-        error_message_buffer, sizeof(error_message_buffer),
-        R"(The integer "%s" must be positive or 0 in column "%s" in file "%s" in line "%d".)",
-        column_content, column_name, file_name, file_line);
-  }
-};
+typedef block_size<1 << 20> default_block_size;
 
-struct no_digit : base,
-                  with_file_name,
-                  with_file_line,
-                  with_column_name,
-                  with_column_content {
-  void format_error_message() const override {
-    std::snprintf(
-        error_message_buffer, sizeof(error_message_buffer),
-        R"(The integer "%s" contains an invalid digit in column "%s" in file "%s" in line "%d".)",
-        column_content, column_name, file_name, file_line);
-  }
+// The place of a line in a file. file_line is the number that get_file_line
+// returns after the line was read.
+struct file_position {
+  long long byte_offset;
+  unsigned file_line;
 };
 
-struct integer_overflow : base,
-                          with_file_name,
-                          with_file_line,
-                          with_column_name,
-                          with_column_content {
-  void format_error_message() const override {
-    std::snprintf(
-        error_message_buffer, sizeof(error_message_buffer),
-        R"(The integer "%s" overflows in column "%s" in file "%s" in line "%d".)",
-        column_content, column_name, file_name, file_line);
-  }
-};
+template <class block_policy = default_block_size> class BasicLineReader {
+private:
+  static const int block_len = block_policy::block_len;
+  static const int prefetch_count = block_policy::prefetch_count;
+  std::unique_ptr<char[]> buffer;
+#ifdef CSV_IO_NO_THREAD
+  detail::SynchronousReader reader;
+#else
+  typename std::conditional<prefetch_count == 0, detail::SynchronousReader,
+                            detail::AsynchronousReader>::type reader;
+#endif
+  int data_begin;
+  int data_end;
 
-struct integer_underflow : base,
-                           with_file_name,
-                           with_file_line,
-                           with_column_name,
-                           with_column_content {
-  void format_error_message() const override {
-    std::snprintf(
-        error_message_buffer, sizeof(error_message_buffer),
-        R"(The integer "%s" underflows in column "%s" in file "%s" in line "%d".)",
-        column_content, column_name, file_name, file_line);
-  }
-};
+  char file_name[error::max_file_name_length + 1];
+  unsigned file_line;
 
-struct invalid_single_character : base,
-                                  with_file_name,
-                                  with_file_line,
-                                  with_column_name,
-                                  with_column_content {
-  void format_error_message() const override {
-    std::snprintf(
-        error_message_buffer, sizeof(error_message_buffer),
-        R"(The content "%s" of column "%s" in file "%s" in line "%d" is not a single character.)",
-        column_content, column_name, file_name, file_line);
-  }
-};
-} // namespace error
+  // The full name of the file if it was opened by name. seek reopens it.
+  std::string path;
+  // The offset in the file of buffer[0] and of the last line.
+  long long buffer_byte_offset = 0;
+  long long line_byte_offset = 0;
+
+  std::size_t max_line_length = block_len - 1;
+  std::unique_ptr<char[]> long_line;
+  std::size_t long_line_capacity = 0;
+
+  // Every block that enters the buffer is searched once for watched_char.
+  // block_has_watched_char[i] refers to the i-th half of the buffer.
+  int watched_char = -1;
+  bool block_has_watched_char[2] = {true, true};
+  bool last_line_may_contain_watched_char = true;
+#ifdef CSV_IO_HAS_MMAP
+  // The mapping is searched in pieces of block_len bytes. The result for the
+  // piece with index checked_piece is cached.
+  long long checked_piece = -1;
+  bool checked_piece_has_watched_char;
+#endif
 
-using ignore_column = unsigned int;
-static const ignore_column ignore_no_column = 0;
-static const ignore_column ignore_extra_column = 1;
-static const ignore_column ignore_missing_column = 2;
+#ifdef CSV_IO_HAS_MMAP
+  // Only used in memory mapped mode. The data pointers are used instead of
+  // data_begin and data_end because mapped files can exceed 2 GiB.
+  bool is_mapped = false;
+  detail::MemoryMappedFile mapping;
+  const char *mapped_data_begin;
+  // The mapping is read-only. Each line is copied into mapped_line to be
+  // null terminated and split in place.
+  std::unique_ptr<char[]> mapped_line;
+  std::size_t mapped_line_capacity = 0;
+#endif
 
-template <char... trim_char_list> struct trim_chars {
-private:
-  constexpr static bool is_trim_char(char) { return false; }
+#ifdef CSV_IO_HAS_POSIX_IO
+  // Only used in follow mode. The buffer holds the lines between data_begin
+  // and data_end, of which the ones before search_begin have no newline. It
+  // grows beyond 2*block_len if max_line_length allows longer lines.
+  bool is_following = false;
+  detail::FollowedFile followed_file;
+  int search_begin;
+  int followed_buffer_len;
+#endif
+  int follow_timeout = -1;
 
-  template <class... OtherTrimChars>
-  constexpr static bool is_trim_char(char c, char trim_char,
-                                     OtherTrimChars... other_trim_chars) {
-    return c == trim_char || is_trim_char(c, other_trim_chars...);
+#ifdef CSV_IO_STATISTICS
+  // consumed_byte_count is derived from the number of bytes read so far and
+  // the bytes still in the buffer when the statistics are queried.
+  mutable line_reader_statistics statistics;
+  long long read_byte_count = 0;
+#endif
+
+#ifdef CSV_IO_HAS_MMAP
+  void init_mapped(const char *file_name) {
+    if (std::FILE *file = mapping.open(file_name)) {
+      record_remaining_file_size(file);
+      init(std::unique_ptr<ByteSourceBase>(
+          new detail::OwningStdIOByteSourceBase(file)));
+      return;
+    }
+    file_line = 0;
+    is_mapped = true;
+    mapped_data_begin = mapping.begin();
+    record_total_byte_count(mapping.end() - mapping.begin());
+    skip_mapped_bom();
   }
 
-public:
-  static void trim(char *&str_begin, char *&str_end) {
-    while (str_begin != str_end && is_trim_char(*str_begin, trim_char_list...))
-      ++str_begin;
-    while (str_begin != str_end &&
-           is_trim_char(*(str_end - 1), trim_char_list...))
-      --str_end;
-    *str_end = '\0';
+  // Ignore UTF-8 BOM
+  void skip_mapped_bom() {
+    if (mapping.end() - mapping.begin() >= 3 &&
+        mapped_data_begin[0] == '\xEF' && mapped_data_begin[1] == '\xBB' &&
+        mapped_data_begin[2] == '\xBF')
+      mapped_data_begin += 3;
   }
-};
 
-struct no_comment {
-  static bool is_comment(const char *) { return false; }
-};
+  char *next_mapped_line() {
+    if (mapped_data_begin == mapping.end())
+      return nullptr;
 
-template <char... comment_start_char_list> struct single_line_comment {
-private:
-  constexpr static bool is_comment_start_char(char) { return false; }
+    ++file_line;
+    count_line();
+    line_byte_offset = mapped_data_begin - mapping.begin();
+
+    const char *line_begin = mapped_data_begin;
+    // The search stops after max_line_length, so that a file without
+    // newlines is neither scanned nor copied as a whole.
+    std::size_t search_len = mapping.end() - line_begin;
+    if (max_line_length < search_len)
+      search_len = max_line_length + 1;
+    const char *line_end = static_cast<const char *>(
+        std::memchr(line_begin, '\n', search_len));
+    if (line_end == nullptr) {
+      if (search_len != static_cast<std::size_t>(mapping.end() - line_begin))
+        throw_line_length_limit_exceeded();
+      // some files are missing the newline at the end of the last line
+      line_end = mapping.end();
+    }
+    if (static_cast<std::size_t>(line_end - line_begin) > max_line_length)
+      throw_line_length_limit_exceeded();
+    mapped_data_begin = line_end == mapping.end() ? line_end : line_end + 1;
+    if (watched_char != -1)
+      last_line_may_contain_watched_char =
+          mapped_range_has_watched_char(line_begin, line_end);
+
+    std::size_t line_length = line_end - line_begin;
+    if (line_length + 1 > mapped_line_capacity) {
+      mapped_line_capacity =
+          (std::max)(2 * mapped_line_capacity, line_length + 1);
+      mapped_line.reset(new char[mapped_line_capacity]);
+    }
+    char *line = mapped_line.get();
+    std::memcpy(line, line_begin, line_length);
+    line[line_length] = '\0';
+    mapping.release_before(mapped_data_begin);
 
-  template <class... OtherCommentStartChars>
-  constexpr static bool
-  is_comment_start_char(char c, char comment_start_char,
-                        OtherCommentStartChars... other_comment_start_chars) {
-    return c == comment_start_char ||
-           is_comment_start_char(c, other_comment_start_chars...);
+    // handle windows \r\n-line breaks
+    if (line_length != 0 && line[line_length - 1] == '\r')
+      line[line_length - 1] = '\0';
+
+    return line;
   }
+#endif
 
-public:
-  static bool is_comment(const char *line) {
-    return is_comment_start_char(*line, comment_start_char_list...);
+#ifdef CSV_IO_HAS_POSIX_IO
+  void init_followed(const char *file_name) {
+    file_line = 0;
+    is_following = true;
+    followed_file.open(file_name);
+    buffer = std::unique_ptr<char[]>(new char[2 * block_len]);
+    followed_buffer_len = 2 * block_len;
+    data_begin = 0;
+    data_end = 0;
+    search_begin = 0;
   }
-};
 
-struct empty_line_comment {
-  static bool is_comment(const char *line) {
-    if (*line == '\0')
-      return true;
-    while (*line == ' ' || *line == '\t') {
-      ++line;
-      if (*line == 0)
-        return true;
+  // Called if the buffer is filled by a line without newline that is not
+  // longer than max_line_length.
+  void grow_followed_buffer() {
+    std::size_t max_len = (std::numeric_limits<int>::max)();
+    if (max_line_length < max_len)
+      max_len = max_line_length + 1;
+    std::size_t len = (std::min)(
+        2 * static_cast<std::size_t>(followed_buffer_len), max_len);
+    if (len <= static_cast<std::size_t>(followed_buffer_len)) {
+      ++file_line;
+      throw_line_length_limit_exceeded();
     }
-    return false;
+    std::unique_ptr<char[]> new_buffer(new char[len]);
+    std::memcpy(new_buffer.get(), buffer.get(), data_end);
+    buffer = std::move(new_buffer);
+    followed_buffer_len = static_cast<int>(len);
   }
-};
 
-template <char... comment_start_char_list>
-struct single_and_empty_line_comment {
-  static bool is_comment(const char *line) {
-    return single_line_comment<comment_start_char_list...>::is_comment(line) ||
-           empty_line_comment::is_comment(line);
-  }
-};
+  char *next_followed_line() {
+    // The timeout bounds the whole call. Appends that do not complete a line
+    // wake the reader up but do not restart the timeout.
+    long long deadline = -1;
+    for (;;) {
+      if (const char *newline = static_cast<const char *>(std::memchr(
+              buffer.get() + search_begin, '\n', data_end - search_begin))) {
+        int line_begin = data_begin;
+        int line_end = newline - buffer.get();
+        data_begin = line_end + 1;
+        search_begin = data_begin;
+
+        ++file_line;
+        count_line();
+        line_byte_offset = buffer_byte_offset + line_begin;
+
+        if (static_cast<std::size_t>(line_end - line_begin) > max_line_length)
+          throw_line_length_limit_exceeded();
+
+        buffer[line_end] = '\0';
+        // handle windows \r\n-line breaks
+        if (line_end != line_begin && buffer[line_end - 1] == '\r')
+          buffer[line_end - 1] = '\0';
+        // Ignore UTF-8 BOM
+        if (line_byte_offset == 0 && line_end - line_begin >= 3 &&
+            buffer[0] == '\xEF' && buffer[1] == '\xBB' && buffer[2] == '\xBF')
+          line_begin += 3;
+        return buffer.get() + line_begin;
+      }
+      search_begin = data_end;
 
-template <char sep> struct no_quote_escape {
-  static const char *find_next_column_end(const char *col_begin) {
-    while (*col_begin != sep && *col_begin != '\0')
-      ++col_begin;
-    return col_begin;
-  }
+      if (static_cast<std::size_t>(data_end - data_begin) > max_line_length) {
+        ++file_line;
+        throw_line_length_limit_exceeded();
+      }
+      if (data_begin == data_end || data_end == followed_buffer_len) {
+        std::memmove(buffer.get(), buffer.get() + data_begin,
+                     data_end - data_begin);
+        buffer_byte_offset += data_begin;
+        data_end -= data_begin;
+        search_begin -= data_begin;
+        data_begin = 0;
+      }
+      if (data_end == followed_buffer_len)
+        grow_followed_buffer();
+
+      int byte_count = followed_file.read(buffer.get() + data_end,
+                                          followed_buffer_len - data_end);
+      if (byte_count != 0) {
+        data_end += byte_count;
+#ifdef CSV_IO_STATISTICS
+        read_byte_count += byte_count;
+#endif
+        continue;
+      }
 
-  static void unescape(char *&, char *&) {}
-};
+      int timeout = follow_timeout;
+      if (follow_timeout >= 0) {
+        long long now = detail::FollowedFile::get_milliseconds();
+        if (deadline == -1)
+          deadline = now + follow_timeout;
+        timeout = deadline > now ? static_cast<int>(deadline - now) : 0;
+      }
 
-template <char sep, char quote> struct double_quote_escape {
+      CSV_IO_PROBE(io_wait_begin);
+#ifdef CSV_IO_STATISTICS
+      long long wait_begin = detail::get_nanoseconds();
+      bool has_changed = followed_file.wait(timeout);
+      statistics.io_wait_nanoseconds += detail::get_nanoseconds() - wait_begin;
+#else
+      bool has_changed = followed_file.wait(timeout);
+#endif
+      CSV_IO_PROBE1(io_wait_end, 0);
+      if (!has_changed)
+        return nullptr;
+    }
+  }
+#endif
+
+  // byte_source must be positioned at start_byte_offset of the file.
+  void init(std::unique_ptr<ByteSourceBase> byte_source,
+            long long start_byte_offset = 0) {
+    file_line = 0;
+
+    if (!buffer)
+      buffer = std::unique_ptr<char[]>(new char[2 * block_len]);
+    data_begin = 0;
+    buffer_byte_offset = start_byte_offset;
+    line_byte_offset = start_byte_offset;
+#ifdef CSV_IO_STATISTICS
+    long long wait_begin = detail::get_nanoseconds();
+#endif
+    data_end = detail::read_fully(*byte_source, buffer.get(), 2 * block_len);
+#ifdef CSV_IO_STATISTICS
+    statistics.io_wait_nanoseconds += detail::get_nanoseconds() - wait_begin;
+    read_byte_count = start_byte_offset + data_end;
+#endif
+
+    // Ignore UTF-8 BOM
+    if (start_byte_offset == 0 && data_end >= 3 && buffer[0] == '\xEF' &&
+        buffer[1] == '\xBB' && buffer[2] == '\xBF')
+      data_begin = 3;
+
+    if (data_end == 2 * block_len)
+      reader.init(std::move(byte_source), block_len, prefetch_count);
+    check_blocks_for_watched_char();
+  }
+
+  void check_blocks_for_watched_char() {
+    block_has_watched_char[0] = has_watched_char(
+        buffer.get(), (std::min)(data_end, static_cast<int>(block_len)));
+    block_has_watched_char[1] =
+        has_watched_char(buffer.get() + block_len, data_end - block_len);
+  }
+
+  bool has_watched_char(const char *begin, long long size) const {
+    if (watched_char == -1)
+      return true;
+    return size > 0 && std::memchr(begin, watched_char,
+                                   static_cast<std::size_t>(size)) != nullptr;
+  }
+
+#ifdef CSV_IO_HAS_MMAP
+  bool mapped_piece_has_watched_char(long long piece) {
+    if (piece != checked_piece) {
+      long long piece_begin = piece * block_len;
+      long long piece_size = (std::min)(
+          static_cast<long long>(block_len),
+          static_cast<long long>(mapping.end() - mapping.begin()) -
+              piece_begin);
+      checked_piece_has_watched_char =
+          has_watched_char(mapping.begin() + piece_begin, piece_size);
+      checked_piece = piece;
+    }
+    return checked_piece_has_watched_char;
+  }
+
+  bool mapped_range_has_watched_char(const char *begin, const char *end) {
+    long long first = (begin - mapping.begin()) / block_len;
+    long long last = (end - mapping.begin()) / block_len;
+    for (long long piece = first; piece <= last; ++piece)
+      if (mapped_piece_has_watched_char(piece))
+        return true;
+    return false;
+  }
+#endif
+
+public:
+  BasicLineReader() = delete;
+  BasicLineReader(const BasicLineReader &) = delete;
+  BasicLineReader &operator=(const BasicLineReader &) = delete;
+
+  explicit BasicLineReader(const char *file_name)
+      : path(file_name != nullptr ? file_name : "") {
+    set_file_name(file_name);
+    record_file_size(file_name);
+    init(detail::open_file(file_name));
+  }
+
+  explicit BasicLineReader(const std::string &file_name) : path(file_name) {
+    set_file_name(file_name.c_str());
+    record_file_size(file_name.c_str());
+    init(detail::open_file(file_name.c_str()));
+  }
+
+  BasicLineReader(const char *file_name,
+             std::unique_ptr<ByteSourceBase> byte_source) {
+    set_file_name(file_name);
+    init(std::move(byte_source));
+  }
+
+  BasicLineReader(const std::string &file_name,
+             std::unique_ptr<ByteSourceBase> byte_source) {
+    set_file_name(file_name.c_str());
+    init(std::move(byte_source));
+  }
+
+  BasicLineReader(const char *file_name, const char *data_begin,
+             const char *data_end) {
+    set_file_name(file_name);
+    record_total_byte_count(data_end - data_begin);
+    init(std::unique_ptr<ByteSourceBase>(new detail::NonOwningStringByteSource(
+        data_begin, data_end - data_begin)));
+  }
+
+  BasicLineReader(const std::string &file_name, const char *data_begin,
+             const char *data_end) {
+    set_file_name(file_name.c_str());
+    record_total_byte_count(data_end - data_begin);
+    init(std::unique_ptr<ByteSourceBase>(new detail::NonOwningStringByteSource(
+        data_begin, data_end - data_begin)));
+  }
+
+  BasicLineReader(const char *file_name, FILE *file) {
+    set_file_name(file_name);
+    record_remaining_file_size(file);
+    init(std::unique_ptr<ByteSourceBase>(
+        new detail::OwningStdIOByteSourceBase(file)));
+  }
+
+  BasicLineReader(const std::string &file_name, FILE *file) {
+    set_file_name(file_name.c_str());
+    record_remaining_file_size(file);
+    init(std::unique_ptr<ByteSourceBase>(
+        new detail::OwningStdIOByteSourceBase(file)));
+  }
+
+  BasicLineReader(const char *file_name, std::istream &in) {
+    set_file_name(file_name);
+    init(std::unique_ptr<ByteSourceBase>(
+        new detail::NonOwningIStreamByteSource(in)));
+  }
+
+  BasicLineReader(const std::string &file_name, std::istream &in) {
+    set_file_name(file_name.c_str());
+    init(std::unique_ptr<ByteSourceBase>(
+        new detail::NonOwningIStreamByteSource(in)));
+  }
+
+  BasicLineReader(const char *file_name, memory_map_t)
+      : path(file_name != nullptr ? file_name : "") {
+    set_file_name(file_name);
+#ifdef CSV_IO_HAS_MMAP
+    init_mapped(file_name);
+#else
+    record_file_size(file_name);
+    init(detail::open_file(file_name));
+#endif
+  }
+
+  BasicLineReader(const std::string &file_name, memory_map_t)
+      : path(file_name) {
+    set_file_name(file_name.c_str());
+#ifdef CSV_IO_HAS_MMAP
+    init_mapped(file_name.c_str());
+#else
+    record_file_size(file_name.c_str());
+    init(detail::open_file(file_name.c_str()));
+#endif
+  }
+
+  BasicLineReader(const char *file_name, follow_t)
+      : path(file_name != nullptr ? file_name : "") {
+    set_file_name(file_name);
+#ifdef CSV_IO_HAS_POSIX_IO
+    init_followed(file_name);
+#else
+    record_file_size(file_name);
+    init(detail::open_file(file_name));
+#endif
+  }
+
+  BasicLineReader(const std::string &file_name, follow_t) : path(file_name) {
+    set_file_name(file_name.c_str());
+#ifdef CSV_IO_HAS_POSIX_IO
+    init_followed(file_name.c_str());
+#else
+    record_file_size(file_name.c_str());
+    init(detail::open_file(file_name.c_str()));
+#endif
+  }
+
+  BasicLineReader(const char *file_name, direct_io_t)
+      : path(file_name != nullptr ? file_name : "") {
+    set_file_name(file_name);
+    record_file_size(file_name);
+    init(open_direct(file_name));
+  }
+
+  BasicLineReader(const std::string &file_name, direct_io_t)
+      : path(file_name) {
+    set_file_name(file_name.c_str());
+    record_file_size(file_name.c_str());
+    init(open_direct(file_name.c_str()));
+  }
+
+  void set_file_name(const std::string &file_name) {
+    set_file_name(file_name.c_str());
+  }
+
+  void set_file_name(const char *file_name) {
+    if (file_name != nullptr) {
+      strncpy(this->file_name, file_name, sizeof(this->file_name) - 1);
+      this->file_name[sizeof(this->file_name) - 1] = '\0';
+    } else {
+      this->file_name[0] = '\0';
+    }
+  }
+
+  const char *get_truncated_file_name() const { return file_name; }
+
+  void set_file_line(unsigned file_line) { this->file_line = file_line; }
+
+  unsigned get_file_line() const { return file_line; }
+
+  // The position of the line that was returned last by next_line. Before the
+  // first line this is the start of the input.
+  file_position get_line_position() const {
+    file_position pos;
+    pos.byte_offset = line_byte_offset;
+    pos.file_line = file_line;
+    return pos;
+  }
+
+  // Continues reading at a position that get_line_position returned earlier.
+  // The next call to next_line returns the line at pos. Only readers that
+  // opened the file by name can seek, others throw error::can_not_seek. The
+  // file is reopened at the offset, also when it was read using direct_io.
+  void seek(file_position pos) {
+#ifdef CSV_IO_HAS_POSIX_IO
+    if (is_following) {
+      followed_file.seek(pos.byte_offset);
+      buffer_byte_offset = pos.byte_offset;
+      line_byte_offset = pos.byte_offset;
+      data_begin = 0;
+      data_end = 0;
+      search_begin = 0;
+#ifdef CSV_IO_STATISTICS
+      read_byte_count = pos.byte_offset;
+#endif
+      file_line = pos.file_line == 0 ? 0 : pos.file_line - 1;
+      return;
+    }
+#endif
+#ifdef CSV_IO_HAS_MMAP
+    if (is_mapped) {
+      long long size = mapping.end() - mapping.begin();
+      if (pos.byte_offset > size)
+        pos.byte_offset = size;
+      mapped_data_begin = mapping.begin() + pos.byte_offset;
+      if (pos.byte_offset == 0)
+        skip_mapped_bom();
+      mapping.restart_release_at(mapped_data_begin);
+      line_byte_offset = pos.byte_offset;
+      file_line = pos.file_line == 0 ? 0 : pos.file_line - 1;
+      return;
+    }
+#endif
+    if (path.empty()) {
+      error::can_not_seek err;
+      err.set_file_name(file_name);
+      throw err;
+    }
+    reader.close();
+    long_line.reset();
+    long_line_capacity = 0;
+    init(detail::open_file_at(path.c_str(), pos.byte_offset), pos.byte_offset);
+    file_line = pos.file_line == 0 ? 0 : pos.file_line - 1;
+  }
+
+#ifdef CSV_IO_STATISTICS
+  const line_reader_statistics &get_statistics() const {
+#ifdef CSV_IO_HAS_MMAP
+    if (is_mapped) {
+      statistics.consumed_byte_count = mapped_data_begin - mapping.begin();
+      return statistics;
+    }
+#endif
+    statistics.consumed_byte_count =
+        read_byte_count - (std::max)(data_end - data_begin, 0);
+    return statistics;
+  }
+#endif
+
+  // Lines with more characters make next_line throw
+  // error::line_length_limit_exceeded. Lines up to block_len-1 characters are
+  // returned from the block buffer. Longer lines are assembled in a separate
+  // buffer that grows geometrically and is freed again once a normal line has
+  // been read. Memory mapped files copy each line into a buffer of its size.
+  void set_max_line_length(std::size_t max_line_length) {
+    this->max_line_length = max_line_length;
+  }
+
+  std::size_t get_max_line_length() const { return max_line_length; }
+
+  // In follow mode next_line returns a null pointer if no complete line was
+  // appended within the timeout. Reading can continue afterwards. A negative
+  // timeout, the default, waits forever.
+  void set_follow_timeout(int milliseconds) { follow_timeout = milliseconds; }
+
+  int get_follow_timeout() const { return follow_timeout; }
+
+  // Makes the reader search every block once for c, which lets
+  // may_last_line_contain_watched_char skip lines that do not contain c.
+  // CSVReader uses this to find lines without quotes. Pass -1 to stop.
+  void set_watched_char(int c) {
+    watched_char = c == -1 ? -1 : static_cast<unsigned char>(c);
+#ifdef CSV_IO_HAS_MMAP
+    checked_piece = -1;
+    if (is_mapped)
+      return;
+#endif
+    if (buffer)
+      check_blocks_for_watched_char();
+  }
+
+  int get_watched_char() const { return watched_char; }
+
+  // Returns false only if the line that next_line returned last does not
+  // contain the watched char. Lines that are longer than a block and
+  // followed files are never checked.
+  bool may_last_line_contain_watched_char() const {
+    return last_line_may_contain_watched_char;
+  }
+
+  char *next_line() {
+#ifdef CSV_IO_HAS_MMAP
+    if (is_mapped)
+      return next_mapped_line();
+#endif
+#ifdef CSV_IO_HAS_POSIX_IO
+    if (is_following)
+      return next_followed_line();
+#endif
+    // data_begin == data_end == 2*block_len happens after a long line that
+    // ended exactly at the end of the buffer. There might be more data.
+    if (data_begin == data_end && data_end != 2 * block_len)
+      return nullptr;
+
+    if (data_begin >= block_len)
+      shift_buffer();
+
+    if (data_begin == data_end)
+      return nullptr;
+
+    ++file_line;
+    count_line();
+    line_byte_offset = buffer_byte_offset + data_begin;
+
+    assert(data_begin < data_end);
+    assert(data_end <= block_len * 2);
+
+    int line_end = data_end;
+    if (const char *newline = static_cast<const char *>(std::memchr(
+            buffer.get() + data_begin, '\n', data_end - data_begin)))
+      line_end = newline - buffer.get();
+
+    if (static_cast<std::size_t>(line_end - data_begin) > max_line_length)
+      throw_line_length_limit_exceeded();
+
+    if (line_end - data_begin + 1 > block_len) {
+      last_line_may_contain_watched_char = true;
+      return next_long_line();
+    }
+
+    // The line starts in the first half of the buffer.
+    last_line_may_contain_watched_char =
+        block_has_watched_char[0] ||
+        (line_end >= block_len && block_has_watched_char[1]);
+
+    if (long_line) {
+      long_line.reset();
+      long_line_capacity = 0;
+    }
+
+    if (line_end != data_end && buffer[line_end] == '\n') {
+      buffer[line_end] = '\0';
+    } else {
+      // some files are missing the newline at the end of the
+      // last line
+      ++data_end;
+      buffer[line_end] = '\0';
+    }
+
+    // handle windows \r\n-line breaks
+    if (line_end != data_begin && buffer[line_end - 1] == '\r')
+      buffer[line_end - 1] = '\0';
+
+    char *ret = buffer.get() + data_begin;
+    data_begin = line_end + 1;
+    return ret;
+  }
+
+private:
+  static std::unique_ptr<ByteSourceBase> open_direct(const char *file_name) {
+#ifdef CSV_IO_HAS_POSIX_IO
+    return std::unique_ptr<ByteSourceBase>(
+        new FileDescriptorByteSource(file_name, true));
+#else
+    return detail::open_file(file_name);
+#endif
+  }
+
+  void shift_buffer() {
+    std::memcpy(buffer.get(), buffer.get() + block_len, block_len);
+    data_begin -= block_len;
+    data_end -= block_len;
+    buffer_byte_offset += block_len;
+    if (reader.is_valid()) {
+      CSV_IO_PROBE(io_wait_begin);
+#ifdef CSV_IO_STATISTICS
+      long long wait_begin = detail::get_nanoseconds();
+      int byte_count = reader.read_block(buffer.get() + block_len);
+      statistics.io_wait_nanoseconds += detail::get_nanoseconds() - wait_begin;
+      read_byte_count += byte_count;
+#else
+      int byte_count = reader.read_block(buffer.get() + block_len);
+#endif
+      CSV_IO_PROBE1(io_wait_end, byte_count);
+      data_end += byte_count;
+      block_has_watched_char[0] = block_has_watched_char[1];
+      block_has_watched_char[1] =
+          has_watched_char(buffer.get() + block_len, byte_count);
+    } else {
+      block_has_watched_char[0] = block_has_watched_char[1];
+      block_has_watched_char[1] = has_watched_char(nullptr, 0);
+    }
+  }
+
+  // The following functions compile to nothing unless CSV_IO_STATISTICS is
+  // defined.
+  void count_line() {
+#ifdef CSV_IO_STATISTICS
+    ++statistics.line_count;
+#endif
+  }
+
+  void record_total_byte_count(long long byte_count) {
+#ifdef CSV_IO_STATISTICS
+    statistics.total_byte_count = byte_count;
+#else
+    (void)byte_count;
+#endif
+  }
+
+  void record_file_size(const char *file_name) {
+#ifdef CSV_IO_STATISTICS
+    statistics.total_byte_count = detail::get_file_size(file_name);
+#else
+    (void)file_name;
+#endif
+  }
+
+  void record_remaining_file_size(std::FILE *file) {
+#ifdef CSV_IO_STATISTICS
+    statistics.total_byte_count = detail::get_remaining_file_size(file);
+#else
+    (void)file;
+#endif
+  }
+
+  void throw_line_length_limit_exceeded() const {
+    error::line_length_limit_exceeded err;
+    err.set_file_name(file_name);
+    err.set_file_line(file_line);
+    throw err;
+  }
+
+  void append_to_long_line(std::size_t &line_length, const char *str,
+                           std::size_t count) {
+    if (line_length + count > max_line_length)
+      throw_line_length_limit_exceeded();
+    if (line_length + count + 1 > long_line_capacity) {
+      std::size_t new_capacity =
+          (std::max)(2 * long_line_capacity, line_length + count + 1);
+      std::unique_ptr<char[]> new_long_line(new char[new_capacity]);
+      if (line_length != 0)
+        std::memcpy(new_long_line.get(), long_line.get(), line_length);
+      long_line = std::move(new_long_line);
+      long_line_capacity = new_capacity;
+    }
+    std::memcpy(long_line.get() + line_length, str, count);
+    line_length += count;
+  }
+
+  char *next_long_line() {
+    std::size_t line_length = 0;
+    for (;;) {
+      int line_end = data_end;
+      if (const char *newline = static_cast<const char *>(std::memchr(
+              buffer.get() + data_begin, '\n', data_end - data_begin)))
+        line_end = newline - buffer.get();
+
+      append_to_long_line(line_length, buffer.get() + data_begin,
+                          line_end - data_begin);
+
+      if (line_end != data_end) {
+        data_begin = line_end + 1;
+        break;
+      }
+      data_begin = data_end;
+      // A buffer that is not full means that the end of file was reached.
+      if (data_end != 2 * block_len)
+        break;
+      shift_buffer();
+    }
+
+    long_line[line_length] = '\0';
+
+    // handle windows \r\n-line breaks
+    if (line_length != 0 && long_line[line_length - 1] == '\r')
+      long_line[line_length - 1] = '\0';
+
+    return long_line.get();
+  }
+};
+
+typedef BasicLineReader<> LineReader;
+
+////////////////////////////////////////////////////////////////////////////
+//                                 CSV                                    //
+////////////////////////////////////////////////////////////////////////////
+
+namespace error {
+const int max_column_name_length = 63;
+struct with_column_name {
+  with_column_name() {
+    std::memset(column_name, 0, max_column_name_length + 1);
+  }
+
+  void set_column_name(const char *column_name) {
+    if (column_name != nullptr) {
+      std::strncpy(this->column_name, column_name, max_column_name_length);
+      this->column_name[max_column_name_length] = '\0';
+    } else {
+      this->column_name[0] = '\0';
+    }
+  }
+
+  char column_name[max_column_name_length + 1];
+};
+
+const int max_column_content_length = 63;
+
+struct with_column_content {
+  with_column_content() {
+    std::memset(column_content, 0, max_column_content_length + 1);
+  }
+
+  void set_column_content(const char *column_content) {
+    if (column_content != nullptr) {
+      std::strncpy(this->column_content, column_content,
+                   max_column_content_length);
+      this->column_content[max_column_content_length] = '\0';
+    } else {
+      this->column_content[0] = '\0';
+    }
+  }
+
+  char column_content[max_column_content_length + 1];
+};
+
+struct extra_column_in_header : base, with_file_name, with_column_name {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  R"(Extra column "%s" in header of file "%s".)", column_name,
+                  file_name);
+  }
+};
+
+struct missing_column_in_header : base, with_file_name, with_column_name {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  R"(Missing column "%s" in header of file "%s".)", column_name,
+                  file_name);
+  }
+};
+
+struct duplicated_column_in_header : base, with_file_name, with_column_name {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  R"(Duplicated column "%s" in header of file "%s".)",
+                  column_name, file_name);
+  }
+};
+
+struct header_missing : base, with_file_name {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  "Header missing in file \"%s\".", file_name);
+  }
+};
+
+struct too_few_columns : base, with_file_name, with_file_line {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  "Too few columns in line %d in file \"%s\".", file_line,
+                  file_name);
+  }
+};
+
+struct too_many_columns : base, with_file_name, with_file_line {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  "Too many columns in line %d in file \"%s\".", file_line,
+                  file_name);
+  }
+};
+
+struct escaped_string_not_closed : base, with_file_name, with_file_line {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  "Escaped string was not closed in line %d in file \"%s\".",
+                  file_line, file_name);
+  }
+};
+
+struct integer_must_be_positive : base,
+                                  with_file_name,
+                                  with_file_line,
+                                  with_column_name,
+                                  with_column_content {
+  void format_error_message() const override {
+    std::snprintf(
+        error_message_buffer, sizeof(error_message_buffer),
+        R"(The integer "%s" must be positive or 0 in column "%s" in file "%s" in line "%d".)",
+        column_content, column_name, file_name, file_line);
+  }
+};
+
+struct no_digit : base,
+                  with_file_name,
+                  with_file_line,
+                  with_column_name,
+                  with_column_content {
+  void format_error_message() const override {
+    std::snprintf(
+        error_message_buffer, sizeof(error_message_buffer),
+        R"(The integer "%s" contains an invalid digit in column "%s" in file "%s" in line "%d".)",
+        column_content, column_name, file_name, file_line);
+  }
+};
+
+struct integer_overflow : base,
+                          with_file_name,
+                          with_file_line,
+                          with_column_name,
+                          with_column_content {
+  void format_error_message() const override {
+    std::snprintf(
+        error_message_buffer, sizeof(error_message_buffer),
+        R"(The integer "%s" overflows in column "%s" in file "%s" in line "%d".)",
+        column_content, column_name, file_name, file_line);
+  }
+};
+
+struct integer_underflow : base,
+                           with_file_name,
+                           with_file_line,
+                           with_column_name,
+                           with_column_content {
+  void format_error_message() const override {
+    std::snprintf(
+        error_message_buffer, sizeof(error_message_buffer),
+        R"(The integer "%s" underflows in column "%s" in file "%s" in line "%d".)",
+        column_content, column_name, file_name, file_line);
+  }
+};
+
+struct invalid_single_character : base,
+                                  with_file_name,
+                                  with_file_line,
+                                  with_column_name,
+                                  with_column_content {
+  void format_error_message() const override {
+    std::snprintf(
+        error_message_buffer, sizeof(error_message_buffer),
+        R"(The content "%s" of column "%s" in file "%s" in line "%d" is not a single character.)",
+        column_content, column_name, file_name, file_line);
+  }
+};
+} // namespace error
+
+// The errors that a row can have. The error policies that do not throw
+// report them using these codes.
+enum class error_code {
+  none,
+  too_few_columns,
+  too_many_columns,
+  escaped_string_not_closed,
+  no_digit,
+  integer_overflow,
+  integer_underflow,
+  invalid_single_character
+};
+
+const int error_code_count = 8;
+
+struct row_error {
+  error_code code;
+  unsigned file_line;
+  // The position of the column in the argument list of read_row, or -1 if
+  // the line could not be split into columns.
+  int column;
+  // The content of the broken column, or nullptr if column is -1. Only valid
+  // while the error handler runs.
+  const char *column_content;
+};
+
+namespace detail {
+inline void throw_error(error_code code) {
+  switch (code) {
+  case error_code::none:
+    break;
+  case error_code::too_few_columns:
+    throw error::too_few_columns();
+  case error_code::too_many_columns:
+    throw error::too_many_columns();
+  case error_code::escaped_string_not_closed:
+    throw error::escaped_string_not_closed();
+  case error_code::no_digit:
+    throw error::no_digit();
+  case error_code::integer_overflow:
+    throw error::integer_overflow();
+  case error_code::integer_underflow:
+    throw error::integer_underflow();
+  case error_code::invalid_single_character:
+    throw error::invalid_single_character();
+  }
+}
+} // namespace detail
+
+// The error policy determines what CSVReader does with a row that can not be
+// parsed. throw_on_error throws an exception. The other policies never throw
+// because of the content of a row. They count the error, pass it to the
+// error handler of the reader and continue.
+struct throw_on_error {
+  static const bool is_throwing = true;
+  static const bool keeps_row = false;
+};
+
+// The row is dropped and the next row is read.
+struct skip_row_on_error {
+  static const bool is_throwing = false;
+  static const bool keeps_row = false;
+};
+
+// A column that can not be converted is set to a value initialized T, such
+// as 0 or the empty string, and the row is kept. Rows that can not be split
+// into the expected columns are dropped.
+struct set_to_default_on_error {
+  static const bool is_throwing = false;
+  static const bool keeps_row = true;
+};
+
+using ignore_column = unsigned int;
+static const ignore_column ignore_no_column = 0;
+static const ignore_column ignore_extra_column = 1;
+static const ignore_column ignore_missing_column = 2;
+
+template <char... trim_char_list> struct trim_chars {
+private:
+  constexpr static bool is_trim_char(char) { return false; }
+
+  template <class... OtherTrimChars>
+  constexpr static bool is_trim_char(char c, char trim_char,
+                                     OtherTrimChars... other_trim_chars) {
+    return c == trim_char || is_trim_char(c, other_trim_chars...);
+  }
+
+public:
+  static void trim(char *&str_begin, char *&str_end) {
+    while (str_begin != str_end && is_trim_char(*str_begin, trim_char_list...))
+      ++str_begin;
+    while (str_begin != str_end &&
+           is_trim_char(*(str_end - 1), trim_char_list...))
+      --str_end;
+    *str_end = '\0';
+  }
+};
+
+struct no_comment {
+  static bool is_comment(const char *) { return false; }
+};
+
+template <char... comment_start_char_list> struct single_line_comment {
+private:
+  constexpr static bool is_comment_start_char(char) { return false; }
+
+  template <class... OtherCommentStartChars>
+  constexpr static bool
+  is_comment_start_char(char c, char comment_start_char,
+                        OtherCommentStartChars... other_comment_start_chars) {
+    return c == comment_start_char ||
+           is_comment_start_char(c, other_comment_start_chars...);
+  }
+
+public:
+  static bool is_comment(const char *line) {
+    return is_comment_start_char(*line, comment_start_char_list...);
+  }
+};
+
+struct empty_line_comment {
+  static bool is_comment(const char *line) {
+    if (*line == '\0')
+      return true;
+    while (*line == ' ' || *line == '\t') {
+      ++line;
+      if (*line == 0)
+        return true;
+    }
+    return false;
+  }
+};
+
+template <char... comment_start_char_list>
+struct single_and_empty_line_comment {
+  static bool is_comment(const char *line) {
+    return single_line_comment<comment_start_char_list...>::is_comment(line) ||
+           empty_line_comment::is_comment(line);
+  }
+};
+
+namespace detail {
+#ifdef CSV_IO_HAS_SSE2
+inline unsigned count_trailing_zeros(unsigned x) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, x);
+  return index;
+#else
+  return __builtin_ctz(x);
+#endif
+}
+#endif
+
+// Returns a pointer to the first character in str that is a, b or '\0'.
+//
+// The SIMD versions only use aligned loads. These never cross a page
+// boundary and thus reading past the null terminator can not fault.
+CSV_IO_NO_SANITIZE inline const char *find_char_or_null(const char *str,
+                                                         char a, char b) {
+#if defined(CSV_IO_HAS_AVX2)
+  const __m256i needle_a = _mm256_set1_epi8(a);
+  const __m256i needle_b = _mm256_set1_epi8(b);
+  const __m256i zero = _mm256_setzero_si256();
+  unsigned misalignment = reinterpret_cast<std::uintptr_t>(str) & 31;
+  const char *block = reinterpret_cast<const char *>(
+      reinterpret_cast<std::uintptr_t>(str) - misalignment);
+  for (;;) {
+    __m256i x = _mm256_load_si256(reinterpret_cast<const __m256i *>(block));
+    __m256i match = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, needle_a),
+                        _mm256_cmpeq_epi8(x, needle_b)),
+        _mm256_cmpeq_epi8(x, zero));
+    unsigned mask =
+        static_cast<unsigned>(_mm256_movemask_epi8(match)) >> misalignment;
+    if (mask != 0)
+      return block + misalignment + count_trailing_zeros(mask);
+    block += 32;
+    misalignment = 0;
+  }
+#elif defined(CSV_IO_HAS_SSE2)
+  const __m128i needle_a = _mm_set1_epi8(a);
+  const __m128i needle_b = _mm_set1_epi8(b);
+  const __m128i zero = _mm_setzero_si128();
+  unsigned misalignment = reinterpret_cast<std::uintptr_t>(str) & 15;
+  const char *block = reinterpret_cast<const char *>(
+      reinterpret_cast<std::uintptr_t>(str) - misalignment);
+  for (;;) {
+    __m128i x = _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+    __m128i match =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, needle_a),
+                                  _mm_cmpeq_epi8(x, needle_b)),
+                     _mm_cmpeq_epi8(x, zero));
+    unsigned mask =
+        static_cast<unsigned>(_mm_movemask_epi8(match)) >> misalignment;
+    if (mask != 0)
+      return block + misalignment + count_trailing_zeros(mask);
+    block += 16;
+    misalignment = 0;
+  }
+#else
+  while (*str != a && *str != b && *str != '\0')
+    ++str;
+  return str;
+#endif
+}
+} // namespace detail
+
+template <char sep> struct no_quote_escape {
   static const char *find_next_column_end(const char *col_begin) {
-    while (*col_begin != sep && *col_begin != '\0')
+    return detail::find_char_or_null(col_begin, sep, sep);
+  }
+
+  static void unescape(char *&, char *&) {}
+
+  // The following members are used by CSVWriter.
+  static const char separator = sep;
+
+  static std::size_t get_max_escaped_length(std::size_t length) {
+    return length;
+  }
+
+  // Copies the column to out. Returns false if it contains the separator or
+  // a newline, as these can not be escaped.
+  static bool escape(const char *col_begin, const char *col_end, char *&out) {
+    for (; col_begin != col_end; ++col_begin) {
+      char c = *col_begin;
+      if (c == sep || c == '\n' || c == '\r')
+        return false;
+      *out++ = c;
+    }
+    return true;
+  }
+};
+
+template <char sep, char quote> struct double_quote_escape {
+  // Returns nullptr if a quoted string is not closed.
+  static const char *try_find_next_column_end(const char *col_begin) {
+    for (;;) {
+      col_begin = detail::find_char_or_null(col_begin, sep, quote);
       if (*col_begin != quote)
+        return col_begin;
+      do {
+        ++col_begin;
+        col_begin = detail::find_char_or_null(col_begin, quote, quote);
+        if (*col_begin == '\0')
+          return nullptr;
+        ++col_begin;
+      } while (*col_begin == quote);
+    }
+  }
+
+  static const char *find_next_column_end(const char *col_begin) {
+    const char *col_end = try_find_next_column_end(col_begin);
+    if (col_end == nullptr)
+      throw error::escaped_string_not_closed();
+    return col_end;
+  }
+
+  static void unescape(char *&col_begin, char *&col_end) {
+    if (col_end - col_begin >= 2) {
+      if (*col_begin == quote && *(col_end - 1) == quote) {
         ++col_begin;
+        --col_end;
+        char *out = col_begin;
+        for (char *in = col_begin; in != col_end; ++in) {
+          if (*in == quote && (in + 1) != col_end && *(in + 1) == quote) {
+            ++in;
+          }
+          *out = *in;
+          ++out;
+        }
+        col_end = out;
+        *col_end = '\0';
+      }
+    }
+  }
+
+  // Lines without the quote character are tokenized using unquoted_policy.
+  static const char quote_char = quote;
+  typedef no_quote_escape<sep> unquoted_policy;
+
+  // The following members are used by CSVWriter.
+  static const char separator = sep;
+
+  static std::size_t get_max_escaped_length(std::size_t length) {
+    return 2 * length + 2;
+  }
+
+  // Quotes the column only if it contains the separator or the quote
+  // character, or if it begins or ends with a space or tab that the trim
+  // policy of a reader would remove. Returns false if the column contains a
+  // newline, as lines can not be continued.
+  static bool escape(const char *col_begin, const char *col_end, char *&out) {
+    bool needs_quotes =
+        col_begin != col_end &&
+        (*col_begin == ' ' || *col_begin == '\t' || *(col_end - 1) == ' ' ||
+         *(col_end - 1) == '\t');
+    for (const char *in = col_begin; in != col_end; ++in) {
+      if (*in == sep || *in == quote)
+        needs_quotes = true;
+      else if (*in == '\n' || *in == '\r')
+        return false;
+    }
+    if (!needs_quotes) {
+      std::memcpy(out, col_begin, col_end - col_begin);
+      out += col_end - col_begin;
+      return true;
+    }
+    *out++ = quote;
+    for (const char *in = col_begin; in != col_end; ++in) {
+      if (*in == quote)
+        *out++ = quote;
+      *out++ = *in;
+    }
+    *out++ = quote;
+    return true;
+  }
+};
+
+struct throw_on_overflow {
+  template <class T> static void on_overflow(T &) {
+    throw error::integer_overflow();
+  }
+
+  template <class T> static void on_underflow(T &) {
+    throw error::integer_underflow();
+  }
+};
+
+struct ignore_overflow {
+  template <class T> static void on_overflow(T &) {}
+
+  template <class T> static void on_underflow(T &) {}
+};
+
+struct set_to_max_on_overflow {
+  template <class T> static void on_overflow(T &x) {
+    // using (std::numeric_limits<T>::max) instead of
+    // std::numeric_limits<T>::max to make code including windows.h with its max
+    // macro happy
+    x = (std::numeric_limits<T>::max)();
+  }
+
+  template <class T> static void on_underflow(T &x) {
+    x = (std::numeric_limits<T>::min)();
+  }
+};
+
+// A fixed-point number with scale digits behind the decimal point. value is
+// the number multiplied by 10^scale, so 12.34 read as decimal<3> has the
+// value 12340. int_type may be __int128 if the standard library supports it
+// as an integer type.
+template <unsigned scale, class int_type = long long> struct decimal {
+  static_assert(std::numeric_limits<int_type>::is_integer &&
+                    std::numeric_limits<int_type>::is_signed,
+                "decimal needs a signed integer type");
+  static_assert(scale <=
+                    static_cast<unsigned>(std::numeric_limits<int_type>::digits10),
+                "the scale of a decimal must leave room for one integer digit");
+
+  int_type value;
+};
+
+template <unsigned scale, class int_type>
+bool operator==(decimal<scale, int_type> l, decimal<scale, int_type> r) {
+  return l.value == r.value;
+}
+template <unsigned scale, class int_type>
+bool operator!=(decimal<scale, int_type> l, decimal<scale, int_type> r) {
+  return l.value != r.value;
+}
+template <unsigned scale, class int_type>
+bool operator<(decimal<scale, int_type> l, decimal<scale, int_type> r) {
+  return l.value < r.value;
+}
+
+namespace detail {
+template <class T> struct make_void { typedef void type; };
+
+// Quote policies may provide try_find_next_column_end, which returns nullptr
+// instead of throwing. Otherwise the error policies that do not throw still
+// get an exception for an escaped string that is not closed.
+template <class quote_policy, class = void>
+struct has_try_find_next_column_end : std::false_type {};
+
+template <class quote_policy>
+struct has_try_find_next_column_end<
+    quote_policy,
+    typename make_void<decltype(
+        &quote_policy::try_find_next_column_end)>::type> : std::true_type {};
+
+template <class quote_policy>
+const char *try_find_next_column_end(const char *col_begin, std::true_type) {
+  return quote_policy::try_find_next_column_end(col_begin);
+}
+
+template <class quote_policy>
+const char *try_find_next_column_end(const char *col_begin, std::false_type) {
+  return quote_policy::find_next_column_end(col_begin);
+}
+
+// Returns false if the column can not be delimited.
+template <class quote_policy>
+bool try_chop_next_column(char *&line, char *&col_begin, char *&col_end) {
+  assert(line != nullptr);
+
+  col_begin = line;
+  const char *end = try_find_next_column_end<quote_policy>(
+      col_begin, has_try_find_next_column_end<quote_policy>());
+  if (end == nullptr)
+    return false;
+  // the col_begin + (... - col_begin) removes the constness
+  col_end = col_begin + (end - col_begin);
+
+  if (*col_end == '\0') {
+    line = nullptr;
+  } else {
+    *col_end = '\0';
+    line = col_end + 1;
+  }
+  return true;
+}
+
+template <class quote_policy>
+void chop_next_column(char *&line, char *&col_begin, char *&col_end) {
+  if (!try_chop_next_column<quote_policy>(line, col_begin, col_end))
+    throw error::escaped_string_not_closed();
+}
+
+// Checks that line consists of exactly column_count columns without
+// splitting them.
+template <class quote_policy> struct column_skipper {
+  static error_code try_skip_columns(const char *line,
+                                     std::size_t column_count) {
+    for (; column_count != 0; --column_count) {
+      if (line == nullptr)
+        return error_code::too_few_columns;
+      const char *col_end = try_find_next_column_end<quote_policy>(
+          line, has_try_find_next_column_end<quote_policy>());
+      if (col_end == nullptr)
+        return error_code::escaped_string_not_closed;
+      line = *col_end == '\0' ? nullptr : col_end + 1;
+    }
+    if (line != nullptr)
+      return error_code::too_many_columns;
+    return error_code::none;
+  }
+};
+
+// Without quotes every separator starts a column, so they are counted in one
+// pass over the line.
+template <char sep> struct column_skipper<no_quote_escape<sep>> {
+  static error_code try_skip_columns(const char *line,
+                                     std::size_t column_count) {
+    std::size_t found_count = 0;
+    if (line != nullptr) {
+      for (;;) {
+        ++found_count;
+        line = find_char_or_null(line, sep, sep);
+        if (*line == '\0')
+          break;
+        ++line;
+      }
+    }
+    if (found_count < column_count)
+      return error_code::too_few_columns;
+    if (found_count > column_count)
+      return error_code::too_many_columns;
+    return error_code::none;
+  }
+};
+
+// col_order contains for every column of the file the index in sorted_col
+// or -1 if the column is ignored. If all columns behind the last requested
+// one are ignored, then ignore_rest_of_line may be inserted in front of
+// them. These columns are then only counted and not split.
+const int ignore_rest_of_line = -2;
+
+template <class trim_policy, class quote_policy>
+error_code try_parse_line(char *line, char **sorted_col,
+                          const std::vector<int> &col_order) {
+  for (auto it = col_order.begin(); it != col_order.end(); ++it) {
+    int i = *it;
+    if (i == ignore_rest_of_line)
+      return column_skipper<quote_policy>::try_skip_columns(
+          line, col_order.end() - it - 1);
+    if (line == nullptr)
+      return error_code::too_few_columns;
+    char *col_begin, *col_end;
+    if (!try_chop_next_column<quote_policy>(line, col_begin, col_end))
+      return error_code::escaped_string_not_closed;
+
+    if (i != -1) {
+      trim_policy::trim(col_begin, col_end);
+      quote_policy::unescape(col_begin, col_end);
+
+      sorted_col[i] = col_begin;
+    }
+  }
+  if (line != nullptr)
+    return error_code::too_many_columns;
+  return error_code::none;
+}
+
+template <class trim_policy, class quote_policy>
+void parse_line(char *line, char **sorted_col,
+                const std::vector<int> &col_order) {
+  error_code code =
+      try_parse_line<trim_policy, quote_policy>(line, sorted_col, col_order);
+  if (code != error_code::none)
+    throw_error(code);
+}
+
+// A quote policy can declare its quote_char and an unquoted_policy that
+// tokenizes text without the quote character in the same way but faster.
+template <class quote_policy, class = void> struct quote_fast_path {
+  static const bool is_enabled = false;
+  static const int quote_char = -1;
+  typedef quote_policy unquoted_policy;
+};
+
+template <class quote_policy>
+struct quote_fast_path<
+    quote_policy,
+    typename make_void<typename quote_policy::unquoted_policy>::type> {
+  static const bool is_enabled = true;
+  static const int quote_char =
+      static_cast<unsigned char>(quote_policy::quote_char);
+  typedef typename quote_policy::unquoted_policy unquoted_policy;
+};
+
+// Use the unquoted policy if the line is known to contain no quote.
+template <class trim_policy, class quote_policy>
+error_code try_parse_line(char *line, char **sorted_col,
+                          const std::vector<int> &col_order,
+                          bool may_contain_quote) {
+  if (!may_contain_quote)
+    return try_parse_line<
+        trim_policy, typename quote_fast_path<quote_policy>::unquoted_policy>(
+        line, sorted_col, col_order);
+  return try_parse_line<trim_policy, quote_policy>(line, sorted_col,
+                                                   col_order);
+}
+
+template <class trim_policy, class quote_policy>
+void parse_line(char *line, char **sorted_col,
+                const std::vector<int> &col_order, bool may_contain_quote) {
+  error_code code = try_parse_line<trim_policy, quote_policy>(
+      line, sorted_col, col_order, may_contain_quote);
+  if (code != error_code::none)
+    throw_error(code);
+}
+
+// FNV-1a, which also determines the length of str.
+inline std::uint64_t hash_string(const char *str, std::size_t &length) {
+  std::uint64_t hash = 14695981039346656037ull;
+  const char *p = str;
+  for (; *p; ++p) {
+    hash ^= static_cast<unsigned char>(*p);
+    hash *= 1099511628211ull;
+  }
+  length = p - str;
+  return hash;
+}
+
+template <unsigned column_count, class trim_policy, class quote_policy>
+void parse_header_line(char *line, std::vector<int> &col_order,
+                       const std::string *col_name,
+                       ignore_column ignore_policy) {
+  col_order.clear();
+
+  // Open addressing hash table of the requested column names. Equal names
+  // are found in the order in which they were requested.
+  std::size_t table_size = 4;
+  while (table_size < 2 * column_count)
+    table_size *= 2;
+  std::size_t mask = table_size - 1;
+  std::vector<int> table(table_size, -1);
+  for (unsigned i = 0; i < column_count; ++i) {
+    std::size_t length;
+    std::size_t j = hash_string(col_name[i].c_str(), length) & mask;
+    while (table[j] != -1)
+      j = (j + 1) & mask;
+    table[j] = i;
+  }
+
+  bool found[column_count];
+  std::fill(found, found + column_count, false);
+  while (line) {
+    char *col_begin, *col_end;
+    chop_next_column<quote_policy>(line, col_begin, col_end);
+
+    trim_policy::trim(col_begin, col_end);
+    quote_policy::unescape(col_begin, col_end);
+
+    std::size_t length;
+    for (std::size_t j = hash_string(col_begin, length) & mask;
+         table[j] != -1; j = (j + 1) & mask) {
+      unsigned i = table[j];
+      if (col_name[i].size() == length &&
+          std::memcmp(col_name[i].data(), col_begin, length) == 0) {
+        if (found[i]) {
+          error::duplicated_column_in_header err;
+          err.set_column_name(col_begin);
+          throw err;
+        }
+        found[i] = true;
+        col_order.push_back(i);
+        col_begin = 0;
+        break;
+      }
+    }
+    if (col_begin) {
+      if (ignore_policy & ::io::ignore_extra_column)
+        col_order.push_back(-1);
       else {
-        do {
-          ++col_begin;
-          while (*col_begin != quote) {
-            if (*col_begin == '\0')
-              throw error::escaped_string_not_closed();
-            ++col_begin;
+        error::extra_column_in_header err;
+        err.set_column_name(col_begin);
+        throw err;
+      }
+    }
+  }
+  std::size_t n = col_order.size();
+  while (n != 0 && col_order[n - 1] == -1)
+    --n;
+  if (n != col_order.size())
+    col_order.insert(col_order.begin() + n, ignore_rest_of_line);
+  if (!(ignore_policy & ::io::ignore_missing_column)) {
+    for (unsigned i = 0; i < column_count; ++i) {
+      if (!found[i]) {
+        error::missing_column_in_header err;
+        err.set_column_name(col_name[i].c_str());
+        throw err;
+      }
+    }
+  }
+}
+
+// The try_parse functions return an error_code instead of throwing. parse
+// throws the corresponding exception.
+
+template <class overflow_policy> error_code try_parse(char *col, char &x) {
+  if (!*col)
+    return error_code::invalid_single_character;
+  x = *col;
+  ++col;
+  if (*col)
+    return error_code::invalid_single_character;
+  return error_code::none;
+}
+
+template <class overflow_policy>
+error_code try_parse(char *col, std::string &x) {
+  x = col;
+  return error_code::none;
+}
+
+template <class overflow_policy>
+error_code try_parse(char *col, const char *&x) {
+  x = col;
+  return error_code::none;
+}
+
+template <class overflow_policy> error_code try_parse(char *col, char *&x) {
+  x = col;
+  return error_code::none;
+}
+
+#ifdef CSV_IO_HAS_STRING_VIEW
+template <class overflow_policy>
+error_code try_parse(char *col, std::string_view &x) {
+  x = col;
+  return error_code::none;
+}
+#endif
+
+// throw_on_overflow is turned into an error code. Other overflow policies
+// are called and may set x or throw an exception of their own.
+template <class overflow_policy, class T>
+error_code handle_overflow(T &x) {
+  if (std::is_same<overflow_policy, throw_on_overflow>::value)
+    return error_code::integer_overflow;
+  overflow_policy::on_overflow(x);
+  return error_code::none;
+}
+
+template <class overflow_policy, class T>
+error_code handle_underflow(T &x) {
+  if (std::is_same<overflow_policy, throw_on_overflow>::value)
+    return error_code::integer_underflow;
+  overflow_policy::on_underflow(x);
+  return error_code::none;
+}
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) ||  \
+    defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)
+// Eight ASCII digits are processed at once using 64 bit integer arithmetic.
+// The first digit is in the lowest byte.
+inline bool is_eight_digits(std::uint64_t v) {
+  return ((v & 0xF0F0F0F0F0F0F0F0) |
+          (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+         0x3333333333333333;
+}
+
+inline std::uint64_t parse_eight_digits(std::uint64_t v) {
+  v -= 0x3030303030303030;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FF) * 0x000F424000000064) +
+       (((v >> 16) & 0x000000FF000000FF) * 0x0000271000000001)) >>
+      32;
+  return v & 0xFFFFFFFF;
+}
+#define CSV_IO_HAS_SWAR
+#endif
+
+// Parses at most 19 digits. These can not overflow. Returns false if there
+// is a character that is not a digit.
+inline bool parse_short_unsigned_integer(const char *col, std::size_t length,
+                                         unsigned long long &x) {
+  x = 0;
+#ifdef CSV_IO_HAS_SWAR
+  for (; length >= 8; length -= 8, col += 8) {
+    std::uint64_t digits;
+    std::memcpy(&digits, col, 8);
+    if (!is_eight_digits(digits))
+      return false;
+    x = 100000000 * x + parse_eight_digits(digits);
+  }
+#endif
+  for (; length != 0; --length, ++col) {
+    if ('0' <= *col && *col <= '9')
+      x = 10 * x + (*col - '0');
+    else
+      return false;
+  }
+  return true;
+}
+
+template <class overflow_policy, class T>
+error_code try_parse_unsigned_integer(const char *col, T &x) {
+  std::size_t length = std::strlen(col);
+  if (length <= static_cast<std::size_t>(std::numeric_limits<T>::digits10)) {
+    unsigned long long y;
+    if (!parse_short_unsigned_integer(col, length, y))
+      return error_code::no_digit;
+    x = static_cast<T>(y);
+    return error_code::none;
+  }
+
+  x = 0;
+  while (*col != '\0') {
+    if ('0' <= *col && *col <= '9') {
+      T y = *col - '0';
+      if (x > ((std::numeric_limits<T>::max)() - y) / 10)
+        return handle_overflow<overflow_policy>(x);
+      x = 10 * x + y;
+    } else
+      return error_code::no_digit;
+    ++col;
+  }
+  return error_code::none;
+}
+
+template <class overflow_policy>
+error_code try_parse(char *col, unsigned char &x) {
+  return try_parse_unsigned_integer<overflow_policy>(col, x);
+}
+template <class overflow_policy>
+error_code try_parse(char *col, unsigned short &x) {
+  return try_parse_unsigned_integer<overflow_policy>(col, x);
+}
+template <class overflow_policy>
+error_code try_parse(char *col, unsigned int &x) {
+  return try_parse_unsigned_integer<overflow_policy>(col, x);
+}
+template <class overflow_policy>
+error_code try_parse(char *col, unsigned long &x) {
+  return try_parse_unsigned_integer<overflow_policy>(col, x);
+}
+template <class overflow_policy>
+error_code try_parse(char *col, unsigned long long &x) {
+  return try_parse_unsigned_integer<overflow_policy>(col, x);
+}
+
+template <class overflow_policy, class T>
+error_code try_parse_signed_integer(const char *col, T &x) {
+  if (*col == '-') {
+    ++col;
+
+    std::size_t length = std::strlen(col);
+    if (length <= static_cast<std::size_t>(std::numeric_limits<T>::digits10)) {
+      unsigned long long y;
+      if (!parse_short_unsigned_integer(col, length, y))
+        return error_code::no_digit;
+      x = -static_cast<T>(y);
+      return error_code::none;
+    }
+
+    x = 0;
+    while (*col != '\0') {
+      if ('0' <= *col && *col <= '9') {
+        T y = *col - '0';
+        if (x < ((std::numeric_limits<T>::min)() + y) / 10)
+          return handle_underflow<overflow_policy>(x);
+        x = 10 * x - y;
+      } else
+        return error_code::no_digit;
+      ++col;
+    }
+    return error_code::none;
+  } else if (*col == '+')
+    ++col;
+  return try_parse_unsigned_integer<overflow_policy>(col, x);
+}
+
+template <class overflow_policy>
+error_code try_parse(char *col, signed char &x) {
+  return try_parse_signed_integer<overflow_policy>(col, x);
+}
+template <class overflow_policy>
+error_code try_parse(char *col, signed short &x) {
+  return try_parse_signed_integer<overflow_policy>(col, x);
+}
+template <class overflow_policy>
+error_code try_parse(char *col, signed int &x) {
+  return try_parse_signed_integer<overflow_policy>(col, x);
+}
+template <class overflow_policy>
+error_code try_parse(char *col, signed long &x) {
+  return try_parse_signed_integer<overflow_policy>(col, x);
+}
+template <class overflow_policy>
+error_code try_parse(char *col, signed long long &x) {
+  return try_parse_signed_integer<overflow_policy>(col, x);
+}
+
+// Powers of ten up to 10^48 are exactly representable as long as the
+// mantissa has at least 113 bits. Fewer are exact for smaller types.
+template <class T> T power_of_ten(int e) {
+  static const T powers[] = {
+      T(1e0L),  T(1e1L),  T(1e2L),  T(1e3L),  T(1e4L),  T(1e5L),  T(1e6L),
+      T(1e7L),  T(1e8L),  T(1e9L),  T(1e10L), T(1e11L), T(1e12L), T(1e13L),
+      T(1e14L), T(1e15L), T(1e16L), T(1e17L), T(1e18L), T(1e19L), T(1e20L),
+      T(1e21L), T(1e22L), T(1e23L), T(1e24L), T(1e25L), T(1e26L), T(1e27L),
+      T(1e28L), T(1e29L), T(1e30L), T(1e31L), T(1e32L), T(1e33L), T(1e34L),
+      T(1e35L), T(1e36L), T(1e37L), T(1e38L), T(1e39L), T(1e40L), T(1e41L),
+      T(1e42L), T(1e43L), T(1e44L), T(1e45L), T(1e46L), T(1e47L), T(1e48L)};
+  return powers[e];
+}
+
+inline void convert_decimal_string(const char *str, float &x) {
+  x = std::strtof(str, nullptr);
+}
+inline void convert_decimal_string(const char *str, double &x) {
+  x = std::strtod(str, nullptr);
+}
+inline void convert_decimal_string(const char *str, long double &x) {
+  x = std::strtold(str, nullptr);
+}
+
+// Reads the digits into an integer without going through a floating point
+// number. Digits behind the scale are rounded to the nearest, ties away from
+// zero. The same decimal separators as for floating points are accepted, but
+// no exponent.
+template <class overflow_policy, unsigned scale, class int_type>
+error_code try_parse(char *col, decimal<scale, int_type> &x) {
+  bool is_neg = false;
+  if (*col == '-') {
+    is_neg = true;
+    ++col;
+  } else if (*col == '+')
+    ++col;
+
+  // The digits are collected as a negative number, as the range of int_type
+  // reaches one further below zero than above it. Otherwise the minimum
+  // could not be read.
+  const int_type limit = is_neg ? (std::numeric_limits<int_type>::min)()
+                                : -(std::numeric_limits<int_type>::max)();
+  int_type value = 0;
+  bool has_digit = false;
+  bool is_overflow = false;
+  for (; '0' <= *col && *col <= '9'; ++col) {
+    int y = *col - '0';
+    if (value < (limit + y) / 10)
+      is_overflow = true;
+    else
+      value = 10 * value - y;
+    has_digit = true;
+  }
+
+  unsigned fraction_digit_count = 0;
+  bool is_rounded_up = false;
+  if (*col == '.' || *col == ',') {
+    ++col;
+    for (; '0' <= *col && *col <= '9'; ++col) {
+      int y = *col - '0';
+      if (fraction_digit_count < scale) {
+        if (value < (limit + y) / 10)
+          is_overflow = true;
+        else
+          value = 10 * value - y;
+      } else if (fraction_digit_count == scale)
+        is_rounded_up = y >= 5;
+      ++fraction_digit_count;
+      has_digit = true;
+    }
+  }
+  if (*col != '\0' || !has_digit)
+    return error_code::no_digit;
+
+  for (; fraction_digit_count < scale; ++fraction_digit_count) {
+    if (value < limit / 10)
+      is_overflow = true;
+    else
+      value = 10 * value;
+  }
+  if (is_rounded_up) {
+    if (value == limit)
+      is_overflow = true;
+    else
+      --value;
+  }
+
+  x.value = is_neg ? value : -value;
+  if (!is_overflow)
+    return error_code::none;
+  if (is_neg)
+    return handle_underflow<overflow_policy>(x.value);
+  return handle_overflow<overflow_policy>(x.value);
+}
+
+template <class T> error_code try_parse_float(const char *col, T &x) {
+  bool is_neg = false;
+  if (*col == '-') {
+    is_neg = true;
+    ++col;
+  } else if (*col == '+')
+    ++col;
+
+  // The value is mantissa * 10^exponent. Only the first 19 significant
+  // digits fit into the mantissa. If any of the remaining digits is not 0
+  // then is_truncated is set.
+  const char *digits_begin = col;
+  unsigned long long mantissa = 0;
+  bool is_truncated = false;
+  long long exponent = 0;
+
+  while (*col == '0')
+    ++col;
+  const char *integer_begin = col;
+  while ('0' <= *col && *col <= '9') {
+    int y = *col - '0';
+    if (col - integer_begin < 19) {
+      mantissa = 10 * mantissa + y;
+    } else {
+      ++exponent;
+      is_truncated |= y != 0;
+    }
+    ++col;
+  }
+  int mantissa_digit_count =
+      static_cast<int>((std::min)(col - integer_begin, std::ptrdiff_t(19)));
+
+  long long fraction_digit_count = 0;
+  if (*col == '.' || *col == ',') {
+    ++col;
+    const char *fraction_begin = col;
+    if (mantissa_digit_count == 0)
+      while (*col == '0')
+        ++col;
+    exponent -= col - fraction_begin;
+    while ('0' <= *col && *col <= '9') {
+      int y = *col - '0';
+      if (mantissa_digit_count < 19) {
+        mantissa = 10 * mantissa + y;
+        ++mantissa_digit_count;
+        --exponent;
+      } else {
+        is_truncated |= y != 0;
+      }
+      ++col;
+    }
+    fraction_digit_count = col - fraction_begin;
+  }
+  const char *digits_end = col;
+
+  int e = 0;
+  if (*col == 'e' || *col == 'E') {
+    ++col;
+    error_code code = try_parse_signed_integer<set_to_max_on_overflow>(col, e);
+    if (code != error_code::none)
+      return code;
+  } else {
+    if (*col != '\0')
+      return error_code::no_digit;
+  }
+  exponent += e;
+
+  // Clinger's fast path: If the mantissa and the power of ten are both
+  // exactly representable then a single multiplication or division is
+  // correctly rounded. This requires that the operation is not evaluated
+  // with a higher precision.
+  const int mantissa_bit_count = std::numeric_limits<T>::digits;
+  const int max_exact_exponent =
+      (std::min)(mantissa_bit_count * 1000 / 2322, 48);
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  bool is_exact = !is_truncated;
+#else
+  bool is_exact = !is_truncated && sizeof(T) == sizeof(long double);
+#endif
+  if (is_exact) {
+    // Move surplus powers of ten into the mantissa while it has room.
+    while (exponent > max_exact_exponent && mantissa_digit_count < 19) {
+      mantissa *= 10;
+      --exponent;
+      ++mantissa_digit_count;
+    }
+    is_exact = (mantissa_bit_count >= 64 ||
+                (mantissa >> (mantissa_bit_count % 64)) == 0) &&
+               -max_exact_exponent <= exponent &&
+               exponent <= max_exact_exponent;
+  }
+
+  if (mantissa == 0) {
+    x = 0;
+  } else if (is_exact) {
+    x = static_cast<T>(mantissa);
+    if (exponent < 0)
+      x /= power_of_ten<T>(static_cast<int>(-exponent));
+    else
+      x *= power_of_ten<T>(static_cast<int>(exponent));
+  } else {
+    // The C library conversion is correctly rounded. The decimal point is
+    // removed from the input because its meaning depends on the locale.
+    std::string normalized;
+    normalized.reserve(digits_end - digits_begin + 24);
+    for (const char *i = digits_begin; i != digits_end; ++i)
+      if (*i != '.' && *i != ',')
+        normalized += *i;
+    normalized += 'e';
+    normalized += std::to_string(e - fraction_digit_count);
+    convert_decimal_string(normalized.c_str(), x);
+  }
+
+  if (is_neg)
+    x = -x;
+  return error_code::none;
+}
+
+template <class T> void parse_float(const char *col, T &x) {
+  error_code code = try_parse_float(col, x);
+  if (code != error_code::none)
+    throw_error(code);
+}
+
+template <class overflow_policy> error_code try_parse(char *col, float &x) {
+  return try_parse_float(col, x);
+}
+template <class overflow_policy> error_code try_parse(char *col, double &x) {
+  return try_parse_float(col, x);
+}
+template <class overflow_policy>
+error_code try_parse(char *col, long double &x) {
+  return try_parse_float(col, x);
+}
+
+template <class overflow_policy, class T>
+error_code try_parse(char *col, T &x) {
+  // Mute unused variable compiler warning
+  (void)col;
+  (void)x;
+  // GCC evaluates "false" when reading the template and
+  // "sizeof(T)!=sizeof(T)" only when instantiating it. This is why
+  // this strange construct is used.
+  static_assert(sizeof(T) != sizeof(T),
+                "Can not parse this type. Only builtin integrals, floats, "
+                "decimal, char, char*, const char*, std::string and "
+                "std::string_view are supported");
+  return error_code::none;
+}
+
+template <class overflow_policy, class T> void parse(char *col, T &x) {
+  error_code code = try_parse<overflow_policy>(col, x);
+  if (code != error_code::none)
+    throw_error(code);
+}
+
+} // namespace detail
+
+// Copies strings into large slabs so that fields can be kept after the
+// buffer of the reader has been overwritten. A string occupies its length
+// plus a null terminator. Strings larger than a quarter slab get a slab of
+// their own. The memory is only released by clear or the destructor.
+class StringArena {
+public:
+  explicit StringArena(std::size_t slab_byte_count = 64 * 1024)
+      : slab_size(slab_byte_count), free_begin(nullptr), free_end(nullptr),
+        byte_count(0) {}
+
+  StringArena(const StringArena &) = delete;
+  StringArena &operator=(const StringArena &) = delete;
+
+  // The moved from arena is empty. It does not keep the free part of the
+  // current slab, which now belongs to the other arena.
+  StringArena(StringArena &&other)
+      : slab_size(other.slab_size), slabs(std::move(other.slabs)),
+        free_begin(other.free_begin), free_end(other.free_end),
+        byte_count(other.byte_count) {
+    other.clear();
+  }
+
+  StringArena &operator=(StringArena &&other) {
+    if (this != &other) {
+      slab_size = other.slab_size;
+      slabs = std::move(other.slabs);
+      free_begin = other.free_begin;
+      free_end = other.free_end;
+      byte_count = other.byte_count;
+      other.clear();
+    }
+    return *this;
+  }
+
+  const char *persist(const char *str, std::size_t length) {
+    char *copy = allocate(length + 1);
+    std::memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+  }
+
+  const char *persist(const char *str) {
+    return persist(str, std::strlen(str));
+  }
+
+  const char *persist(const std::string &str) {
+    return persist(str.data(), str.size());
+  }
+
+#ifdef CSV_IO_HAS_STRING_VIEW
+  std::string_view persist(std::string_view str) {
+    return std::string_view(persist(str.data(), str.size()), str.size());
+  }
+#endif
+
+  // Bytes handed out by persist, including null terminators.
+  std::size_t get_byte_count() const { return byte_count; }
+
+  // Invalidates all strings returned by persist.
+  void clear() {
+    slabs.clear();
+    free_begin = nullptr;
+    free_end = nullptr;
+    byte_count = 0;
+  }
+
+private:
+  char *allocate(std::size_t size) {
+    byte_count += size;
+    if (static_cast<std::size_t>(free_end - free_begin) >= size) {
+      char *ret = free_begin;
+      free_begin += size;
+      return ret;
+    }
+    if (size > slab_size / 4) {
+      // Keep the current slab open for the following small strings.
+      slabs.emplace_back(new char[size]);
+      return slabs.back().get();
+    }
+    slabs.emplace_back(new char[slab_size]);
+    free_begin = slabs.back().get() + size;
+    free_end = slabs.back().get() + slab_size;
+    return slabs.back().get();
+  }
+
+  std::size_t slab_size;
+  std::vector<std::unique_ptr<char[]>> slabs;
+  char *free_begin;
+  char *free_end;
+  std::size_t byte_count;
+};
+
+// The code of a low cardinality string column. The string is interned in
+// the CategoryDictionary of the column owned by the CSVReader.
+struct category {
+  std::uint32_t code;
+};
+
+inline bool operator==(category l, category r) { return l.code == r.code; }
+inline bool operator!=(category l, category r) { return l.code != r.code; }
+inline bool operator<(category l, category r) { return l.code < r.code; }
+
+// Maps strings to consecutive codes in the order of their first occurrence.
+// Lookups hash the string and probe an open addressing table that stores the
+// codes and their hashes. The strings are stored once in an arena.
+class CategoryDictionary {
+public:
+  CategoryDictionary() : used_slot_count(0) {}
+
+  CategoryDictionary(const CategoryDictionary &) = delete;
+  CategoryDictionary &operator=(const CategoryDictionary &) = delete;
+
+  CategoryDictionary(CategoryDictionary &&) = default;
+  CategoryDictionary &operator=(CategoryDictionary &&) = default;
+
+  category intern(const char *str) {
+    std::size_t length;
+    std::uint64_t hash = detail::hash_string(str, length);
+    if (2 * (used_slot_count + 1) > slots.size())
+      grow();
+    std::size_t mask = slots.size() - 1;
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+      slot &s = slots[i];
+      if (s.code == empty_slot) {
+        s.code = static_cast<std::uint32_t>(values.size());
+        s.hash = hash;
+        values.push_back(strings.persist(str, length));
+        lengths.push_back(length);
+        ++used_slot_count;
+        return category{s.code};
+      }
+      if (s.hash == hash && lengths[s.code] == length &&
+          std::memcmp(values[s.code], str, length) == 0)
+        return category{s.code};
+    }
+  }
+
+  // Returns false if str has not been interned.
+  bool find(const char *str, category &c) const {
+    if (slots.empty())
+      return false;
+    std::size_t length;
+    std::uint64_t hash = detail::hash_string(str, length);
+    std::size_t mask = slots.size() - 1;
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+      const slot &s = slots[i];
+      if (s.code == empty_slot)
+        return false;
+      if (s.hash == hash && lengths[s.code] == length &&
+          std::memcmp(values[s.code], str, length) == 0) {
+        c.code = s.code;
+        return true;
+      }
+    }
+  }
+
+  std::size_t size() const { return values.size(); }
+
+  // The returned string is null terminated.
+  const char *get_value(category c) const { return values[c.code]; }
+  std::size_t get_length(category c) const { return lengths[c.code]; }
+
+private:
+  static const std::uint32_t empty_slot = 0xFFFFFFFFu;
+
+  struct slot {
+    std::uint32_t code;
+    std::uint64_t hash;
+  };
+
+  void grow() {
+    std::vector<slot> old_slots(std::max<std::size_t>(16, 2 * slots.size()),
+                                slot{empty_slot, 0});
+    old_slots.swap(slots);
+    std::size_t mask = slots.size() - 1;
+    for (const slot &s : old_slots) {
+      if (s.code == empty_slot)
+        continue;
+      std::size_t i = s.hash & mask;
+      while (slots[i].code != empty_slot)
+        i = (i + 1) & mask;
+      slots[i] = s;
+    }
+  }
+
+  std::vector<slot> slots;
+  std::size_t used_slot_count;
+  std::vector<const char *> values;
+  std::vector<std::size_t> lengths;
+  StringArena strings;
+};
+
+namespace detail {
+// Copies up to max_row_count lines that are no comments into buffer, as the
+// LineReader only keeps the current line valid. on_comment is called for
+// every comment line. Returns whether one of the lines may contain the
+// watched character. If reading a line throws, then no line is kept, so that
+// the batch is empty instead of half filled.
+template <class comment_policy, class LineReader, class OnComment>
+bool read_line_batch(LineReader &in, std::size_t max_row_count,
+                     std::vector<char> &buffer,
+                     std::vector<std::size_t> &line_begin,
+                     std::vector<unsigned> &file_line, OnComment on_comment) {
+  buffer.clear();
+  line_begin.clear();
+  file_line.clear();
+  bool may_contain_watched_char = false;
+  try {
+    while (line_begin.size() < max_row_count) {
+      char *line = in.next_line();
+      if (!line)
+        break;
+      if (comment_policy::is_comment(line)) {
+        on_comment();
+        continue;
+      }
+      may_contain_watched_char |= in.may_last_line_contain_watched_char();
+      line_begin.push_back(buffer.size());
+      file_line.push_back(in.get_file_line());
+      buffer.insert(buffer.end(), line, line + std::strlen(line) + 1);
+    }
+  } catch (...) {
+    line_begin.clear();
+    file_line.clear();
+    throw;
+  }
+  return may_contain_watched_char;
+}
+} // namespace detail
+
+#ifdef CSV_IO_STATISTICS
+// The per column arrays are indexed by the position of the column in the
+// argument list of read_row and read_rows.
+template <unsigned column_count>
+struct csv_reader_statistics : line_reader_statistics {
+  long long comment_line_count = 0;
+  long long tokenize_nanoseconds = 0;
+  long long conversion_nanoseconds[column_count] = {};
+  long long conversion_error_count[column_count] = {};
+};
+#endif
+
+template <unsigned column_count, class trim_policy = trim_chars<' ', '\t'>,
+          class quote_policy = no_quote_escape<','>,
+          class overflow_policy = throw_on_overflow,
+          class comment_policy = no_comment,
+          class block_policy = default_block_size,
+          class error_policy = throw_on_error>
+class CSVReader {
+private:
+  BasicLineReader<block_policy> in;
+
+  char *row[column_count];
+  std::string column_names[column_count];
+
+  std::vector<int> col_order;
+
+  // Used by read_rows. The lines of a batch are copied into batch_buffer as
+  // the LineReader only keeps the current line valid.
+  std::vector<char> batch_buffer;
+  std::vector<std::size_t> batch_line_begin;
+  std::vector<unsigned> batch_file_line;
+  std::vector<char *> batch_row;
+  // If read_rows throws, the rows behind the broken row stay in the batch
+  // and are returned by the next read_rows. The rows in front of
+  // batch_tokenized_row_count are already split into batch_row, which
+  // modifies their lines in place. If batch_tokenize_error is set, the row
+  // at batch_tokenized_row_count could not be split.
+  std::size_t batch_next_row = 0;
+  std::size_t batch_tokenized_row_count = 0;
+  std::exception_ptr batch_tokenize_error;
+  bool batch_lines_may_contain_quote = false;
+  // Used by read_rows if the error policy does not throw.
+  std::vector<char> batch_row_is_broken;
+
+  StringArena arena;
+
+  // Indexed by the position of the column in the argument list of read_row.
+  CategoryDictionary dictionaries[column_count];
+
+  std::function<void(const row_error &)> error_handler;
+  // Indexed by error_code.
+  unsigned long long error_count[error_code_count] = {};
+  unsigned long long skipped_row_count = 0;
+
+#ifdef CSV_IO_STATISTICS
+  mutable csv_reader_statistics<column_count> statistics;
+#endif
+
+  template <class... ColNames>
+  void set_column_names(std::string s, ColNames... cols) {
+    column_names[column_count - sizeof...(ColNames) - 1] = std::move(s);
+    set_column_names(std::forward<ColNames>(cols)...);
+  }
+
+  void set_column_names() {}
+
+public:
+  CSVReader() = delete;
+  CSVReader(const CSVReader &) = delete;
+  CSVReader &operator=(const CSVReader &);
+
+  template <class... Args>
+  explicit CSVReader(Args &&... args) : in(std::forward<Args>(args)...) {
+    std::fill(row, row + column_count, nullptr);
+    col_order.resize(column_count);
+    for (unsigned i = 0; i < column_count; ++i)
+      col_order[i] = i;
+    for (unsigned i = 1; i <= column_count; ++i)
+      column_names[i - 1] = "col" + std::to_string(i);
+    if (detail::quote_fast_path<quote_policy>::is_enabled)
+      in.set_watched_char(detail::quote_fast_path<quote_policy>::quote_char);
+  }
+
+  char *next_line() { return in.next_line(); }
+
+  template <class... ColNames>
+  void read_header(ignore_column ignore_policy, ColNames... cols) {
+    static_assert(sizeof...(ColNames) >= column_count,
+                  "not enough column names specified");
+    static_assert(sizeof...(ColNames) <= column_count,
+                  "too many column names specified");
+    try {
+      set_column_names(std::forward<ColNames>(cols)...);
+
+      char *line;
+      do {
+        line = in.next_line();
+        if (!line)
+          throw error::header_missing();
+      } while (comment_policy::is_comment(line));
+
+      detail::parse_header_line<column_count, trim_policy, quote_policy>(
+          line, col_order, column_names, ignore_policy);
+    } catch (error::with_file_name &err) {
+      err.set_file_name(in.get_truncated_file_name());
+      throw;
+    }
+  }
+
+  template <class... ColNames> void set_header(ColNames... cols) {
+    static_assert(sizeof...(ColNames) >= column_count,
+                  "not enough column names specified");
+    static_assert(sizeof...(ColNames) <= column_count,
+                  "too many column names specified");
+    set_column_names(std::forward<ColNames>(cols)...);
+    std::fill(row, row + column_count, nullptr);
+    col_order.resize(column_count);
+    for (unsigned i = 0; i < column_count; ++i)
+      col_order[i] = i;
+  }
+
+  bool has_column(const std::string &name) const {
+    return col_order.end() !=
+           std::find(col_order.begin(), col_order.end(),
+                     std::find(std::begin(column_names), std::end(column_names),
+                               name) -
+                         std::begin(column_names));
+  }
+
+  void set_file_name(const std::string &file_name) {
+    in.set_file_name(file_name);
+  }
+
+  void set_file_name(const char *file_name) { in.set_file_name(file_name); }
+
+  const char *get_truncated_file_name() const {
+    return in.get_truncated_file_name();
+  }
+
+  void set_file_line(unsigned file_line) { in.set_file_line(file_line); }
+
+  unsigned get_file_line() const { return in.get_file_line(); }
+
+  // The position of the last row read. See BasicLineReader::seek.
+  file_position get_line_position() const { return in.get_line_position(); }
+
+  // Rows left over in a batch of read_rows are dropped.
+  void seek(file_position pos) {
+    in.seek(pos);
+    batch_next_row = batch_line_begin.size();
+  }
+
+  void set_max_line_length(std::size_t max_line_length) {
+    in.set_max_line_length(max_line_length);
+  }
+
+  std::size_t get_max_line_length() const {
+    return in.get_max_line_length();
+  }
+
+  void set_follow_timeout(int milliseconds) {
+    in.set_follow_timeout(milliseconds);
+  }
+
+  int get_follow_timeout() const { return in.get_follow_timeout(); }
+
+  // Copies a field into the arena of the reader. The copy stays valid after
+  // the next read_row until the arena is cleared or the reader destroyed.
+  const char *persist(const char *field) { return arena.persist(field); }
+
+#ifdef CSV_IO_HAS_STRING_VIEW
+  std::string_view persist(std::string_view field) {
+    return arena.persist(field);
+  }
+#endif
+
+  StringArena &get_arena() { return arena; }
+
+  // The dictionary of the category column at position r in the argument
+  // list of read_row and read_rows.
+  const CategoryDictionary &get_dictionary(std::size_t r) const {
+    return dictionaries[r];
+  }
+
+  // Called for every error of a row that the error policy does not throw.
+  void set_error_handler(std::function<void(const row_error &)> handler) {
+    error_handler = std::move(handler);
+  }
+
+  // The number of errors that the error policy did not throw.
+  unsigned long long get_error_count(error_code code) const {
+    return error_count[static_cast<int>(code)];
+  }
+
+  unsigned long long get_error_count() const {
+    unsigned long long sum = 0;
+    for (int i = 0; i < error_code_count; ++i)
+      sum += error_count[i];
+    return sum;
+  }
+
+  // The number of rows that were dropped because of an error.
+  unsigned long long get_skipped_row_count() const {
+    return skipped_row_count;
+  }
+
+#ifdef CSV_IO_STATISTICS
+  const csv_reader_statistics<column_count> &get_statistics() const {
+    static_cast<line_reader_statistics &>(statistics) = in.get_statistics();
+    return statistics;
+  }
+#endif
+
+private:
+  template <class T> void parse_column(std::size_t r, char *col, T &t) {
+#ifdef CSV_IO_STATISTICS
+    long long conversion_begin = detail::get_nanoseconds();
+#endif
+    try {
+      try {
+        try {
+          convert(r, col, t);
+        } catch (error::with_column_content &err) {
+          err.set_column_content(col);
+          throw;
+        }
+      } catch (error::with_column_name &err) {
+        err.set_column_name(column_names[r].c_str());
+        CSV_IO_PROBE2(conversion_error, in.get_file_line(), r);
+        throw;
+      }
+    } catch (...) {
+#ifdef CSV_IO_STATISTICS
+      ++statistics.conversion_error_count[r];
+      statistics.conversion_nanoseconds[r] +=
+          detail::get_nanoseconds() - conversion_begin;
+#endif
+      throw;
+    }
+#ifdef CSV_IO_STATISTICS
+    statistics.conversion_nanoseconds[r] +=
+        detail::get_nanoseconds() - conversion_begin;
+#endif
+  }
+
+  template <class T> void convert(std::size_t, char *col, T &t) {
+    ::io::detail::parse<overflow_policy>(col, t);
+  }
+
+  void convert(std::size_t r, char *col, category &t) {
+    t = dictionaries[r].intern(col);
+  }
+
+  template <class T> error_code try_convert(std::size_t, char *col, T &t) {
+    return ::io::detail::try_parse<overflow_policy>(col, t);
+  }
+
+  error_code try_convert(std::size_t r, char *col, category &t) {
+    t = dictionaries[r].intern(col);
+    return error_code::none;
+  }
+
+  void report_error(error_code code, unsigned file_line, int r,
+                    const char *col) {
+    ++error_count[static_cast<int>(code)];
+    if (error_handler) {
+      row_error err = {code, file_line, r, col};
+      error_handler(err);
+    }
+  }
+
+  // The counterpart of parse_column for error policies that do not throw.
+  // Returns false if the row must be dropped.
+  template <class T>
+  bool try_parse_column(unsigned file_line, std::size_t r, char *col, T &t) {
+#ifdef CSV_IO_STATISTICS
+    long long conversion_begin = detail::get_nanoseconds();
+#endif
+    error_code code = try_convert(r, col, t);
+#ifdef CSV_IO_STATISTICS
+    statistics.conversion_nanoseconds[r] +=
+        detail::get_nanoseconds() - conversion_begin;
+#endif
+    if (code == error_code::none)
+      return true;
+#ifdef CSV_IO_STATISTICS
+    ++statistics.conversion_error_count[r];
+#endif
+    CSV_IO_PROBE2(conversion_error, file_line, r);
+    report_error(code, file_line, static_cast<int>(r), col);
+    if (!error_policy::keeps_row)
+      return false;
+    t = T();
+    return true;
+  }
+
+  // The following functions compile to nothing unless CSV_IO_STATISTICS is
+  // defined.
+  void count_comment_line() {
+#ifdef CSV_IO_STATISTICS
+    ++statistics.comment_line_count;
+#endif
+  }
+
+  long long get_tokenize_begin() const {
+#ifdef CSV_IO_STATISTICS
+    return detail::get_nanoseconds();
+#else
+    return 0;
+#endif
+  }
+
+  void record_tokenize_end(long long tokenize_begin) {
+#ifdef CSV_IO_STATISTICS
+    statistics.tokenize_nanoseconds += detail::get_nanoseconds() - tokenize_begin;
+#else
+    (void)tokenize_begin;
+#endif
+  }
+
+  void parse_helper(std::size_t) {}
+
+  template <class T, class... ColType>
+  void parse_helper(std::size_t r, T &t, ColType &... cols) {
+    if (row[r])
+      parse_column(r, row[r], t);
+    parse_helper(r + 1, cols...);
+  }
+
+  bool try_parse_helper(unsigned, std::size_t) { return true; }
+
+  template <class T, class... ColType>
+  bool try_parse_helper(unsigned file_line, std::size_t r, T &t,
+                        ColType &... cols) {
+    if (row[r] && !try_parse_column(file_line, r, row[r], t))
+      return false;
+    return try_parse_helper(file_line, r + 1, cols...);
+  }
+
+  void append_batch_rows(std::size_t) {}
+
+  template <class T, class... ColType>
+  void append_batch_rows(std::size_t row_count, std::vector<T> &col,
+                         std::vector<ColType> &... cols) {
+    col.resize(col.size() + row_count);
+    append_batch_rows(row_count, cols...);
+  }
+
+  void remove_batch_rows(std::size_t) {}
+
+  template <class T, class... ColType>
+  void remove_batch_rows(std::size_t row_count, std::vector<T> &col,
+                         std::vector<ColType> &... cols) {
+    col.resize(col.size() - row_count);
+    remove_batch_rows(row_count, cols...);
+  }
+
+  void parse_batch_columns(std::size_t, char **, std::size_t) {}
+
+  // Converts column r of all rows before moving on to the next column. The
+  // rows were already appended to the vectors. cells points to the columns
+  // of the first row.
+  template <class T, class... ColType>
+  void parse_batch_columns(std::size_t r, char **cells, std::size_t row_count,
+                           std::vector<T> &col,
+                           std::vector<ColType> &... cols) {
+    char **cell = cells + r;
+    T *out = col.data() + (col.size() - row_count);
+    for (std::size_t i = 0; i < row_count; ++i, cell += column_count)
+      if (*cell)
+        parse_column(r, *cell, out[i]);
+    parse_batch_columns(r + 1, cells, row_count, cols...);
+  }
+
+  void try_parse_batch_columns(std::size_t, std::size_t) {}
+
+  // Like parse_batch_columns but marks the rows that must be dropped in
+  // batch_row_is_broken instead of throwing.
+  template <class T, class... ColType>
+  void try_parse_batch_columns(std::size_t r, std::size_t row_count,
+                               std::vector<T> &col,
+                               std::vector<ColType> &... cols) {
+    char **cell = batch_row.data() + r;
+    T *out = col.data() + (col.size() - row_count);
+    for (std::size_t i = 0; i < row_count; ++i, cell += column_count)
+      if (*cell && !batch_row_is_broken[i] &&
+          !try_parse_column(batch_file_line[i], r, *cell, out[i]))
+        batch_row_is_broken[i] = 1;
+    try_parse_batch_columns(r + 1, row_count, cols...);
+  }
+
+  void remove_broken_batch_rows(std::size_t) {}
+
+  template <class T, class... ColType>
+  void remove_broken_batch_rows(std::size_t row_count, std::vector<T> &col,
+                                std::vector<ColType> &... cols) {
+    T *out = col.data() + (col.size() - row_count);
+    std::size_t kept_row_count = 0;
+    for (std::size_t i = 0; i < row_count; ++i)
+      if (!batch_row_is_broken[i]) {
+        if (kept_row_count != i)
+          out[kept_row_count] = std::move(out[i]);
+        ++kept_row_count;
+      }
+    col.resize(col.size() - (row_count - kept_row_count));
+    remove_broken_batch_rows(row_count, cols...);
+  }
+
+  // Starts a new batch of up to max_row_count lines. Returns whether one of
+  // them may contain a quote. If this throws, the batch is empty.
+  bool read_batch_lines(std::size_t max_row_count) {
+    batch_next_row = 0;
+    batch_tokenized_row_count = 0;
+    batch_tokenize_error = nullptr;
+    bool batch_may_contain_quote = detail::read_line_batch<comment_policy>(
+        in, max_row_count, batch_buffer, batch_line_begin, batch_file_line,
+        [&] { count_comment_line(); });
+    batch_row.assign(batch_line_begin.size() * column_count, nullptr);
+    return batch_may_contain_quote;
+  }
+
+  template <class... ColType> bool read_row_without_throwing(ColType &... cols) {
+    try {
+      try {
+        for (;;) {
+          char *line = in.next_line();
+          if (!line)
+            return false;
+          if (comment_policy::is_comment(line)) {
+            count_comment_line();
+            continue;
+          }
+          unsigned file_line = in.get_file_line();
+          CSV_IO_PROBE1(row, file_line);
+
+          long long tokenize_begin = get_tokenize_begin();
+          error_code code = detail::try_parse_line<trim_policy, quote_policy>(
+              line, row, col_order, in.may_last_line_contain_watched_char());
+          record_tokenize_end(tokenize_begin);
+
+          if (code != error_code::none)
+            report_error(code, file_line, -1, nullptr);
+          else if (try_parse_helper(file_line, 0, cols...))
+            return true;
+          ++skipped_row_count;
+        }
+      } catch (error::with_file_name &err) {
+        err.set_file_name(in.get_truncated_file_name());
+        throw;
+      }
+    } catch (error::with_file_line &err) {
+      err.set_file_line(in.get_file_line());
+      throw;
+    }
+  }
+
+  template <class... ColType>
+  std::size_t read_rows_without_throwing(std::size_t max_row_count,
+                                         std::vector<ColType> &... cols) {
+    // A batch in which every row is broken is followed by the next one, as
+    // 0 is only returned at the end of the file.
+    for (;;) {
+      bool batch_may_contain_quote;
+      try {
+        batch_may_contain_quote = read_batch_lines(max_row_count);
+      } catch (error::with_file_name &err) {
+        err.set_file_name(in.get_truncated_file_name());
+        throw;
+      }
+      std::size_t row_count = batch_line_begin.size();
+      if (row_count == 0)
+        return 0;
+
+      // The rows that can be split into columns are moved to the front.
+      std::size_t tokenized_row_count = 0;
+      long long tokenize_begin = get_tokenize_begin();
+      for (std::size_t i = 0; i < row_count; ++i) {
+        error_code code = detail::try_parse_line<trim_policy, quote_policy>(
+            batch_buffer.data() + batch_line_begin[i],
+            batch_row.data() + tokenized_row_count * column_count, col_order,
+            batch_may_contain_quote);
+        if (code != error_code::none) {
+          report_error(code, batch_file_line[i], -1, nullptr);
+          ++skipped_row_count;
+          std::fill(batch_row.data() + tokenized_row_count * column_count,
+                    batch_row.data() + (tokenized_row_count + 1) * column_count,
+                    nullptr);
+          continue;
+        }
+        batch_file_line[tokenized_row_count] = batch_file_line[i];
+        ++tokenized_row_count;
+      }
+      record_tokenize_end(tokenize_begin);
+
+      append_batch_rows(tokenized_row_count, cols...);
+      batch_row_is_broken.assign(tokenized_row_count, 0);
+      try_parse_batch_columns(0, tokenized_row_count, cols...);
+
+      std::size_t broken_row_count =
+          std::count(batch_row_is_broken.begin(), batch_row_is_broken.end(), 1);
+      if (broken_row_count != 0) {
+        remove_broken_batch_rows(tokenized_row_count, cols...);
+        skipped_row_count += broken_row_count;
+      }
+      if (tokenized_row_count != broken_row_count)
+        return tokenized_row_count - broken_row_count;
+    }
+  }
+
+  void parse_batch_row(std::size_t, char **, std::size_t, std::size_t) {}
+
+  template <class T, class... ColType>
+  void parse_batch_row(std::size_t r, char **cells, std::size_t i,
+                       std::size_t row_count, std::vector<T> &col,
+                       std::vector<ColType> &... cols) {
+    if (char *cell = cells[i * column_count + r])
+      parse_column(r, cell, col[col.size() - row_count + i]);
+    parse_batch_row(r + 1, cells, i, row_count, cols...);
+  }
+
+public:
+  // Moves past the next row without parsing it. Returns false at the end of
+  // the file.
+  bool skip_row() {
+    for (;;) {
+      char *line = in.next_line();
+      if (!line)
+        return false;
+      if (!comment_policy::is_comment(line))
+        return true;
+      count_comment_line();
+    }
+  }
+
+  template <class... ColType> bool read_row(ColType &... cols) {
+    static_assert(sizeof...(ColType) >= column_count,
+                  "not enough columns specified");
+    static_assert(sizeof...(ColType) <= column_count,
+                  "too many columns specified");
+    if (!error_policy::is_throwing)
+      return read_row_without_throwing(cols...);
+    try {
+      try {
+        char *line;
+        for (;;) {
+          line = in.next_line();
+          if (!line)
+            return false;
+          if (!comment_policy::is_comment(line))
+            break;
+          count_comment_line();
+        }
+        CSV_IO_PROBE1(row, in.get_file_line());
+
+        long long tokenize_begin = get_tokenize_begin();
+        detail::parse_line<trim_policy, quote_policy>(
+            line, row, col_order, in.may_last_line_contain_watched_char());
+        record_tokenize_end(tokenize_begin);
+
+        parse_helper(0, cols...);
+      } catch (error::with_file_name &err) {
+        err.set_file_name(in.get_truncated_file_name());
+        throw;
+      }
+    } catch (error::with_file_line &err) {
+      err.set_file_line(in.get_file_line());
+      throw;
+    }
+
+    return true;
+  }
+
+  // Appends up to max_row_count rows to the vectors and returns the number of
+  // rows appended. Returns 0 only at the end of the file. If a row is broken,
+  // the rows in front of it are appended and its exception is thrown. The
+  // rows behind it are returned by the next call, before any new line is
+  // read. read_row, skip_row and next_line do not see these rows.
+  template <class... ColType>
+  std::size_t read_rows(std::size_t max_row_count,
+                        std::vector<ColType> &... cols) {
+    static_assert(sizeof...(ColType) >= column_count,
+                  "not enough columns specified");
+    static_assert(sizeof...(ColType) <= column_count,
+                  "too many columns specified");
+    if (!error_policy::is_throwing)
+      return read_rows_without_throwing(max_row_count, cols...);
+
+    if (batch_next_row == batch_line_begin.size())
+      batch_lines_may_contain_quote = read_batch_lines(max_row_count);
+    std::size_t first_row = batch_next_row;
+    std::size_t end_row =
+        (std::min)(batch_line_begin.size(), first_row + max_row_count);
+
+    long long tokenize_begin = get_tokenize_begin();
+    try {
+      try {
+        for (; !batch_tokenize_error && batch_tokenized_row_count < end_row;
+             ++batch_tokenized_row_count)
+          detail::parse_line<trim_policy, quote_policy>(
+              batch_buffer.data() + batch_line_begin[batch_tokenized_row_count],
+              batch_row.data() + batch_tokenized_row_count * column_count,
+              col_order, batch_lines_may_contain_quote);
+      } catch (error::with_file_name &err) {
+        err.set_file_name(in.get_truncated_file_name());
+        throw;
+      }
+    } catch (error::with_file_line &err) {
+      err.set_file_line(batch_file_line[batch_tokenized_row_count]);
+      batch_tokenize_error = std::current_exception();
+    }
+    record_tokenize_end(tokenize_begin);
+
+    std::size_t row_count =
+        (std::min)(end_row, batch_tokenized_row_count) - first_row;
+    char **cells = batch_row.data() + first_row * column_count;
+    append_batch_rows(row_count, cols...);
+#ifdef CSV_IO_STATISTICS
+    std::vector<long long> error_count_before(
+        std::begin(statistics.conversion_error_count),
+        std::end(statistics.conversion_error_count));
+#endif
+    try {
+      parse_batch_columns(0, cells, row_count, cols...);
+    } catch (...) {
+#ifdef CSV_IO_STATISTICS
+      // The error is counted again by the row by row conversion.
+      std::copy(error_count_before.begin(), error_count_before.end(),
+                statistics.conversion_error_count);
+#endif
+      // Redo the conversion row by row to keep exactly the rows in front
+      // of the first broken row and to throw the same error as read_row.
+      for (std::size_t i = 0; i < row_count; ++i) {
+        try {
+          try {
+            try {
+              parse_batch_row(0, cells, i, row_count, cols...);
+            } catch (...) {
+              remove_batch_rows(row_count - i, cols...);
+              batch_next_row = first_row + i + 1;
+              throw;
+            }
+          } catch (error::with_file_name &err) {
+            err.set_file_name(in.get_truncated_file_name());
+            throw;
+          }
+        } catch (error::with_file_line &err) {
+          err.set_file_line(batch_file_line[first_row + i]);
+          throw;
+        }
+      }
+    }
+
+    batch_next_row = first_row + row_count;
+    if (batch_tokenize_error && batch_next_row < end_row) {
+      // The broken row is skipped by the next call.
+      ++batch_next_row;
+      ++batch_tokenized_row_count;
+      std::exception_ptr tokenize_error = batch_tokenize_error;
+      batch_tokenize_error = nullptr;
+      std::rethrow_exception(tokenize_error);
+    }
+
+    return row_count;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////
+//                             Dynamic CSV                                //
+////////////////////////////////////////////////////////////////////////////
+
+enum class column_type {
+  string,           // std::string
+  integer,          // long long
+  unsigned_integer, // unsigned long long
+  floating_point,   // double
+  category          // io::category
+};
+
+template <class trim_policy = trim_chars<' ', '\t'>,
+          class quote_policy = no_quote_escape<','>,
+          class overflow_policy = throw_on_overflow,
+          class comment_policy = no_comment,
+          class block_policy = default_block_size>
+class DynamicCSVReader {
+private:
+  struct column;
+
+  // Converts the cells of one column of a batch. Returns the number of rows
+  // in front of the first broken cell and stores its exception in
+  // column_error.
+  typedef std::size_t (*convert_function)(column &col, char *const *cell,
+                                          std::size_t cell_stride,
+                                          std::size_t row_count,
+                                          const unsigned *file_line,
+                                          const char *file_name,
+                                          std::exception_ptr &column_error);
+
+  struct column {
+    std::string name;
+    column_type type;
+    convert_function convert;
+
+    std::vector<std::string> strings;
+    std::vector<long long> integers;
+    std::vector<unsigned long long> unsigned_integers;
+    std::vector<double> floating_points;
+    std::vector<category> categories;
+    CategoryDictionary dictionary;
+
+    std::vector<std::string> &get_values(std::string *) { return strings; }
+    std::vector<long long> &get_values(long long *) { return integers; }
+    std::vector<unsigned long long> &get_values(unsigned long long *) {
+      return unsigned_integers;
+    }
+    std::vector<double> &get_values(double *) { return floating_points; }
+    std::vector<category> &get_values(category *) { return categories; }
+
+    void resize(std::size_t row_count) {
+      switch (type) {
+      case column_type::string:
+        strings.resize(row_count);
+        break;
+      case column_type::integer:
+        integers.resize(row_count);
+        break;
+      case column_type::unsigned_integer:
+        unsigned_integers.resize(row_count);
+        break;
+      case column_type::floating_point:
+        floating_points.resize(row_count);
+        break;
+      case column_type::category:
+        categories.resize(row_count);
+        break;
+      }
+    }
+  };
+
+  BasicLineReader<block_policy> in;
+
+  std::vector<std::string> file_column_names;
+  // For every column in the file the position of the selected column or -1.
+  std::vector<int> col_order;
+  // col_order with ignore_rest_of_line in front of the unselected columns at
+  // the end of the line. Used to tokenize the rows.
+  std::vector<int> row_col_order;
+  std::vector<column> columns;
+
+  std::vector<char> batch_buffer;
+  std::vector<std::size_t> batch_line_begin;
+  std::vector<unsigned> batch_file_line;
+  std::vector<char *> batch_row;
+  // The rows of a batch behind a broken row are kept for the next read_rows.
+  // See CSVReader.
+  std::size_t batch_next_row = 0;
+  std::size_t batch_tokenized_row_count = 0;
+  std::exception_ptr batch_tokenize_error;
+  bool batch_lines_may_contain_quote = false;
+
+  static void convert_cell(column &, char *cell, std::string &x) { x = cell; }
+
+  static void convert_cell(column &col, char *cell, category &x) {
+    x = col.dictionary.intern(cell);
+  }
+
+  template <class T> static void convert_cell(column &, char *cell, T &x) {
+    ::io::detail::parse<overflow_policy>(cell, x);
+  }
+
+  template <class T>
+  static std::size_t convert_column(column &col, char *const *cell,
+                                    std::size_t cell_stride,
+                                    std::size_t row_count,
+                                    const unsigned *file_line,
+                                    const char *file_name,
+                                    std::exception_ptr &column_error) {
+    std::vector<T> &values = col.get_values(static_cast<T *>(nullptr));
+    values.resize(row_count);
+    for (std::size_t i = 0; i < row_count; ++i, cell += cell_stride) {
+      try {
+        try {
+          try {
+            try {
+              convert_cell(col, *cell, values[i]);
+            } catch (error::with_column_content &err) {
+              err.set_column_content(*cell);
+              throw;
+            }
+          } catch (error::with_column_name &err) {
+            err.set_column_name(col.name.c_str());
+            throw;
+          }
+        } catch (error::with_file_name &err) {
+          err.set_file_name(file_name);
+          throw;
+        }
+      } catch (error::with_file_line &err) {
+        err.set_file_line(file_line[i]);
+        column_error = std::current_exception();
+        return i;
+      }
+    }
+    return row_count;
+  }
+
+  static convert_function get_convert_function(column_type type) {
+    switch (type) {
+    case column_type::string:
+      return &convert_column<std::string>;
+    case column_type::integer:
+      return &convert_column<long long>;
+    case column_type::unsigned_integer:
+      return &convert_column<unsigned long long>;
+    case column_type::floating_point:
+      return &convert_column<double>;
+    case column_type::category:
+      return &convert_column<category>;
+    }
+    return nullptr;
+  }
+
+  void set_file_columns(std::vector<std::string> names) {
+    for (std::size_t i = 0; i < names.size(); ++i)
+      for (std::size_t j = 0; j < i; ++j)
+        if (names[i] == names[j]) {
+          error::duplicated_column_in_header err;
+          err.set_column_name(names[i].c_str());
+          err.set_file_name(in.get_truncated_file_name());
+          throw err;
+        }
+    file_column_names = std::move(names);
+    col_order.assign(file_column_names.size(), -1);
+    columns.clear();
+    update_row_col_order();
+  }
+
+  // The rows left over in a batch were split for the old selection of
+  // columns and are therefore dropped.
+  void update_row_col_order() {
+    batch_next_row = batch_line_begin.size();
+    std::size_t n = col_order.size();
+    while (n != 0 && col_order[n - 1] == -1)
+      --n;
+    row_col_order = col_order;
+    if (n != col_order.size())
+      row_col_order.insert(row_col_order.begin() + n,
+                           detail::ignore_rest_of_line);
+  }
+
+public:
+  DynamicCSVReader() = delete;
+  DynamicCSVReader(const DynamicCSVReader &) = delete;
+  DynamicCSVReader &operator=(const DynamicCSVReader &) = delete;
+
+  template <class... Args>
+  explicit DynamicCSVReader(Args &&... args) : in(std::forward<Args>(args)...) {
+    if (detail::quote_fast_path<quote_policy>::is_enabled)
+      in.set_watched_char(detail::quote_fast_path<quote_policy>::quote_char);
+  }
+
+  // Reads the names of all columns of the file from the first line that is
+  // not a comment.
+  void read_header() {
+    try {
+      char *line;
+      do {
+        line = in.next_line();
+        if (!line)
+          throw error::header_missing();
+      } while (comment_policy::is_comment(line));
+
+      std::vector<std::string> names;
+      while (line) {
+        char *col_begin, *col_end;
+        detail::chop_next_column<quote_policy>(line, col_begin, col_end);
+        trim_policy::trim(col_begin, col_end);
+        quote_policy::unescape(col_begin, col_end);
+        names.push_back(col_begin);
+      }
+      set_file_columns(std::move(names));
+    } catch (error::with_file_name &err) {
+      err.set_file_name(in.get_truncated_file_name());
+      throw;
+    }
+  }
+
+  // Names the columns of a file without a header line.
+  void set_header(std::vector<std::string> names) {
+    set_file_columns(std::move(names));
+  }
+
+  std::size_t get_file_column_count() const { return file_column_names.size(); }
+
+  const std::string &get_file_column_name(std::size_t i) const {
+    return file_column_names[i];
+  }
+
+  bool has_column(const std::string &name) const {
+    return std::find(file_column_names.begin(), file_column_names.end(),
+                     name) != file_column_names.end();
+  }
+
+  // Selects a column of the file for reading. Returns the position of the
+  // column among the selected columns. Columns are converted in the order in
+  // which they are added.
+  std::size_t add_column(const std::string &name, column_type type) {
+    std::size_t i =
+        std::find(file_column_names.begin(), file_column_names.end(), name) -
+        file_column_names.begin();
+    if (i == file_column_names.size()) {
+      error::missing_column_in_header err;
+      err.set_column_name(name.c_str());
+      err.set_file_name(in.get_truncated_file_name());
+      throw err;
+    }
+    if (col_order[i] != -1) {
+      error::duplicated_column_in_header err;
+      err.set_column_name(name.c_str());
+      err.set_file_name(in.get_truncated_file_name());
+      throw err;
+    }
+    col_order[i] = static_cast<int>(columns.size());
+    update_row_col_order();
+    columns.emplace_back();
+    column &col = columns.back();
+    col.name = name;
+    col.type = type;
+    col.convert = get_convert_function(type);
+    return columns.size() - 1;
+  }
+
+  std::size_t get_column_count() const { return columns.size(); }
+
+  column_type get_column_type(std::size_t c) const { return columns[c].type; }
+
+  const std::string &get_column_name(std::size_t c) const {
+    return columns[c].name;
+  }
+
+  // The values of column c of the last batch. T must be the C++ type that
+  // corresponds to the column_type of the column.
+  template <class T> const std::vector<T> &get_values(std::size_t c) const {
+    return const_cast<column &>(columns[c])
+        .get_values(static_cast<T *>(nullptr));
+  }
+
+  const CategoryDictionary &get_dictionary(std::size_t c) const {
+    return columns[c].dictionary;
+  }
+
+  char *next_line() { return in.next_line(); }
+
+  void set_file_name(const std::string &file_name) {
+    in.set_file_name(file_name);
+  }
+
+  void set_file_name(const char *file_name) { in.set_file_name(file_name); }
+
+  const char *get_truncated_file_name() const {
+    return in.get_truncated_file_name();
+  }
+
+  void set_file_line(unsigned file_line) { in.set_file_line(file_line); }
+
+  unsigned get_file_line() const { return in.get_file_line(); }
+
+  // The position of the last row read. See BasicLineReader::seek.
+  file_position get_line_position() const { return in.get_line_position(); }
+
+  // Rows left over in a batch of read_rows are dropped.
+  void seek(file_position pos) {
+    in.seek(pos);
+    batch_next_row = batch_line_begin.size();
+  }
+
+  void set_max_line_length(std::size_t max_line_length) {
+    in.set_max_line_length(max_line_length);
+  }
+
+  std::size_t get_max_line_length() const {
+    return in.get_max_line_length();
+  }
+
+  void set_follow_timeout(int milliseconds) {
+    in.set_follow_timeout(milliseconds);
+  }
+
+  int get_follow_timeout() const { return in.get_follow_timeout(); }
+
+  // Replaces the values of all selected columns by the next up to
+  // max_row_count rows and returns their number. Returns 0 only at the end of
+  // the file. If a row is broken, the values hold the rows in front of it and
+  // its exception is thrown. The rows behind it are returned by the next
+  // call, before any new line is read. skip_row and next_line do not see
+  // these rows.
+  std::size_t read_rows(std::size_t max_row_count) {
+    std::size_t column_count = columns.size();
+    if (batch_next_row == batch_line_begin.size()) {
+      batch_next_row = 0;
+      batch_tokenized_row_count = 0;
+      batch_tokenize_error = nullptr;
+      batch_lines_may_contain_quote = detail::read_line_batch<comment_policy>(
+          in, max_row_count, batch_buffer, batch_line_begin, batch_file_line,
+          [] {});
+      batch_row.assign(batch_line_begin.size() * column_count, nullptr);
+    }
+    std::size_t first_row = batch_next_row;
+    std::size_t end_row =
+        (std::min)(batch_line_begin.size(), first_row + max_row_count);
+
+    try {
+      try {
+        for (; !batch_tokenize_error && batch_tokenized_row_count < end_row;
+             ++batch_tokenized_row_count)
+          detail::parse_line<trim_policy, quote_policy>(
+              batch_buffer.data() + batch_line_begin[batch_tokenized_row_count],
+              batch_row.data() + batch_tokenized_row_count * column_count,
+              row_col_order, batch_lines_may_contain_quote);
+      } catch (error::with_file_name &err) {
+        err.set_file_name(in.get_truncated_file_name());
+        throw;
+      }
+    } catch (error::with_file_line &err) {
+      err.set_file_line(batch_file_line[batch_tokenized_row_count]);
+      batch_tokenize_error = std::current_exception();
+    }
+
+    // Every column stops at the first broken row found so far, so that in
+    // the end the rows in front of the first broken row are kept.
+    std::size_t valid_row_count =
+        (std::min)(end_row, batch_tokenized_row_count) - first_row;
+    std::exception_ptr batch_error;
+    for (std::size_t c = 0; c < column_count; ++c) {
+      std::exception_ptr column_error;
+      std::size_t n = columns[c].convert(
+          columns[c], batch_row.data() + first_row * column_count + c,
+          column_count, valid_row_count, batch_file_line.data() + first_row,
+          in.get_truncated_file_name(), column_error);
+      if (n != valid_row_count) {
+        valid_row_count = n;
+        batch_error = column_error;
+      }
+    }
+    for (std::size_t c = 0; c < column_count; ++c)
+      columns[c].resize(valid_row_count);
+
+    // The broken row is skipped by the next call.
+    batch_next_row = first_row + valid_row_count;
+    if (batch_error) {
+      ++batch_next_row;
+      std::rethrow_exception(batch_error);
+    }
+    if (batch_tokenize_error && batch_next_row < end_row) {
+      ++batch_next_row;
+      ++batch_tokenized_row_count;
+      std::exception_ptr tokenize_error = batch_tokenize_error;
+      batch_tokenize_error = nullptr;
+      std::rethrow_exception(tokenize_error);
+    }
+
+    return valid_row_count;
+  }
+
+  bool read_row() { return read_rows(1) != 0; }
+
+  // Moves past the next row without parsing it. Returns false at the end of
+  // the file.
+  bool skip_row() {
+    for (;;) {
+      char *line = in.next_line();
+      if (!line)
+        return false;
+      if (!comment_policy::is_comment(line))
+        return true;
+    }
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////
+//                               CSV Writer                               //
+////////////////////////////////////////////////////////////////////////////
+
+namespace error {
+struct can_not_write_file : base, with_file_name, with_errno {
+  void format_error_message() const override {
+    if (errno_value != 0)
+      std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                    "Can not write file \"%s\" because \"%s\".", file_name,
+                    std::strerror(errno_value));
+    else
+      std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                    "Can not write file \"%s\".", file_name);
+  }
+};
+
+struct unwritable_column_content : base,
+                                   with_file_name,
+                                   with_file_line,
+                                   with_column_content {
+  void format_error_message() const override {
+    std::snprintf(
+        error_message_buffer, sizeof(error_message_buffer),
+        R"(The content "%s" can not be written to line %d in file "%s" because it could not be read back. Only finite numbers and strings without a newline or a separator that the quote policy can not escape can be written.)",
+        column_content, file_line, file_name);
+  }
+};
+} // namespace error
+
+class ByteSinkBase {
+public:
+  virtual void write(const char *buffer, int size) = 0;
+  // Called by CSVWriter::flush after all blocks have been written.
+  virtual void flush() {}
+  virtual ~ByteSinkBase() {}
+};
+
+namespace detail {
+class OwningStdIOByteSink : public ByteSinkBase {
+public:
+  explicit OwningStdIOByteSink(FILE *file) : file(file) {
+    // Tell the std library that we want to do the buffering ourself.
+    std::setvbuf(file, 0, _IONBF, 0);
+  }
+
+  void write(const char *buffer, int size) {
+    if (std::fwrite(buffer, 1, size, file) != static_cast<std::size_t>(size))
+      throw_can_not_write_file();
+  }
+
+  void flush() {
+    if (std::fflush(file) != 0)
+      throw_can_not_write_file();
+  }
+
+  ~OwningStdIOByteSink() { std::fclose(file); }
+
+private:
+  static void throw_can_not_write_file() {
+    int x = errno;
+    error::can_not_write_file err;
+    err.set_errno(x);
+    throw err;
+  }
+
+  FILE *file;
+};
+
+class NonOwningOStreamByteSink : public ByteSinkBase {
+public:
+  explicit NonOwningOStreamByteSink(std::ostream &out) : out(out) {}
+
+  void write(const char *buffer, int size) {
+    out.write(buffer, size);
+    if (!out)
+      throw error::can_not_write_file();
+  }
+
+  void flush() {
+    out.flush();
+    if (!out)
+      throw error::can_not_write_file();
+  }
+
+  ~NonOwningOStreamByteSink() {}
+
+private:
+  std::ostream &out;
+};
+
+inline std::unique_ptr<ByteSinkBase> create_file(const char *file_name) {
+  FILE *file = std::fopen(file_name, "wb");
+  if (file == 0) {
+    int x = errno;
+    error::can_not_open_file err;
+    err.set_errno(x);
+    err.set_file_name(file_name);
+    throw err;
+  }
+  return std::unique_ptr<ByteSinkBase>(new OwningStdIOByteSink(file));
+}
+
+#ifndef CSV_IO_NO_THREAD
+// Writes the blocks filled by the formatter on a separate thread. This is the
+// mirror image of AsynchronousReader: the blocks are handed over through a
+// single producer single consumer ring and the threads only park when the
+// ring is full or empty for longer than a short spin. After a write error
+// the worker discards the remaining blocks and the error is rethrown by the
+// next call of get_block or flush.
+class AsynchronousWriter {
+public:
+  void init(std::unique_ptr<ByteSinkBase> arg_byte_sink, int arg_block_len,
+            int arg_block_count) {
+    byte_sink = std::move(arg_byte_sink);
+    block_len = arg_block_len;
+    block_count = arg_block_count;
+    ring.reset(new char[static_cast<std::size_t>(block_len) * block_count]);
+    block_byte_count.reset(new int[block_count]);
+    worker = std::thread([&] {
+      auto can_read = [&] {
+        return fill_position.load() != drain_position.load() ||
+               termination_requested.load();
+      };
+      for (unsigned position = 0;; ++position) {
+        consumer_waiter.wait(can_read);
+        if (fill_position.load() == position && termination_requested.load())
+          return;
+
+        int slot = position % block_count;
+        if (!has_failed.load()) {
+          try {
+            byte_sink->write(block(slot), block_byte_count[slot]);
+          } catch (...) {
+            write_error = std::current_exception();
+            has_failed.store(true);
           }
-          ++col_begin;
-        } while (*col_begin == quote);
+        }
+        drain_position.store(position + 1);
+        producer_waiter.wake();
       }
-    return col_begin;
+    });
+  }
+
+  // Returns the block that the next call to write_block hands over.
+  char *get_block() {
+    unsigned position = fill_position.load(std::memory_order_relaxed);
+    producer_waiter.wait([&] {
+      return position - drain_position.load() !=
+             static_cast<unsigned>(block_count);
+    });
+    rethrow_write_error();
+    return block(position % block_count);
+  }
+
+  void write_block(int byte_count) {
+    rethrow_write_error();
+    unsigned position = fill_position.load(std::memory_order_relaxed);
+    block_byte_count[position % block_count] = byte_count;
+    fill_position.store(position + 1);
+    consumer_waiter.wake();
+  }
+
+  // Waits until all blocks have been written.
+  void flush() {
+    unsigned position = fill_position.load(std::memory_order_relaxed);
+    producer_waiter.wait([&] { return drain_position.load() == position; });
+    rethrow_write_error();
+    byte_sink->flush();
+  }
+
+  ~AsynchronousWriter() {
+    if (byte_sink != nullptr) {
+      termination_requested.store(true);
+      consumer_waiter.force_wake();
+      worker.join();
+    }
+  }
+
+private:
+  char *block(int slot) {
+    return ring.get() + static_cast<std::size_t>(slot) * block_len;
+  }
+
+  // Once a write failed, the worker drops all later blocks. The error is
+  // therefore reported again by every later call.
+  void rethrow_write_error() {
+    if (has_failed.load())
+      std::rethrow_exception(write_error);
+  }
+
+  std::unique_ptr<ByteSinkBase> byte_sink;
+
+  std::thread worker;
+
+  int block_len;
+  int block_count;
+  std::unique_ptr<char[]> ring;
+  std::unique_ptr<int[]> block_byte_count;
+  std::exception_ptr write_error;
+  std::atomic<bool> has_failed{false};
+
+  // Number of blocks filled by the formatter and written by the worker. Only
+  // the respective thread writes its position.
+  std::atomic<unsigned> fill_position{0};
+  std::atomic<unsigned> drain_position{0};
+  std::atomic<bool> termination_requested{false};
+
+  SpinThenParkWaiter producer_waiter;
+  SpinThenParkWaiter consumer_waiter;
+};
+#endif
+
+// Writes in the calling thread.
+class SynchronousWriter {
+public:
+  void init(std::unique_ptr<ByteSinkBase> arg_byte_sink, int arg_block_len,
+            int) {
+    byte_sink = std::move(arg_byte_sink);
+    buffer.reset(new char[arg_block_len]);
+  }
+
+  char *get_block() { return buffer.get(); }
+
+  void write_block(int byte_count) {
+    byte_sink->write(buffer.get(), byte_count);
+  }
+
+  void flush() { byte_sink->flush(); }
+
+private:
+  std::unique_ptr<ByteSinkBase> byte_sink;
+  std::unique_ptr<char[]> buffer;
+};
+
+// Writes the decimal digits of x in front of end and returns a pointer to
+// the first digit. Two digits are produced per division.
+template <class T> char *format_unsigned_integer(T x, char *end) {
+  static const char digit_pairs[] = "00010203040506070809"
+                                    "10111213141516171819"
+                                    "20212223242526272829"
+                                    "30313233343536373839"
+                                    "40414243444546474849"
+                                    "50515253545556575859"
+                                    "60616263646566676869"
+                                    "70717273747576777879"
+                                    "80818283848586878889"
+                                    "90919293949596979899";
+  while (x >= 100) {
+    unsigned i = static_cast<unsigned>(x % 100) * 2;
+    x /= 100;
+    *--end = digit_pairs[i + 1];
+    *--end = digit_pairs[i];
+  }
+  if (x >= 10) {
+    unsigned i = static_cast<unsigned>(x) * 2;
+    *--end = digit_pairs[i + 1];
+    *--end = digit_pairs[i];
+  } else {
+    *--end = static_cast<char>('0' + x);
+  }
+  return end;
+}
+
+// Enough for 64 bit integers including the sign and for the shortest
+// representation of all floating point types.
+const int max_number_length = 64;
+
+template <class T> char *format_integer(T x, char *out) {
+  typedef typename std::make_unsigned<T>::type U;
+  char digits[max_number_length];
+  char *end = digits + max_number_length;
+  char *begin;
+  if (x < 0) {
+    // Negate in unsigned arithmetic to handle the minimum value.
+    begin = format_unsigned_integer(static_cast<U>(U(0) - static_cast<U>(x)),
+                                    end);
+    *--begin = '-';
+  } else {
+    begin = format_unsigned_integer(static_cast<U>(x), end);
+  }
+  std::memcpy(out, begin, end - begin);
+  return out + (end - begin);
+}
+
+template <unsigned scale, class int_type>
+char *format_decimal(decimal<scale, int_type> x, char *out) {
+  char digits[max_number_length];
+  char *end = digits + max_number_length;
+  char *begin = end;
+  // Division truncates towards zero, so the digits of a negative value are
+  // produced without negating it, which would overflow for the minimum.
+  int_type v = x.value;
+  do {
+    int y = static_cast<int>(v % 10);
+    *--begin = static_cast<char>('0' + (y < 0 ? -y : y));
+    v /= 10;
+  } while (v != 0);
+  if (x.value < 0)
+    *out++ = '-';
+  // At least one digit in front of the decimal point.
+  while (end - begin <= static_cast<std::ptrdiff_t>(scale))
+    *--begin = '0';
+  std::size_t integer_length = (end - begin) - scale;
+  std::memcpy(out, begin, integer_length);
+  out += integer_length;
+  if (scale != 0) {
+    *out++ = '.';
+    std::memcpy(out, begin + integer_length, scale);
+    out += scale;
+  }
+  return out;
+}
+
+// Writes the shortest decimal representation that parse_float reads back as
+// the same value. The output does not depend on the locale. NaN and infinity
+// are written as nan, inf and -inf, which parse_float rejects.
+template <class T> char *format_float(T x, char *out) {
+  if (x != x) {
+    std::memcpy(out, "nan", 3);
+    return out + 3;
+  }
+  if (x == std::numeric_limits<T>::infinity()) {
+    std::memcpy(out, "inf", 3);
+    return out + 3;
+  }
+  if (x == -std::numeric_limits<T>::infinity()) {
+    std::memcpy(out, "-inf", 4);
+    return out + 4;
+  }
+#ifdef CSV_IO_HAS_TO_CHARS
+  return std::to_chars(out, out + max_number_length, x).ptr;
+#else
+  const int min_precision = std::numeric_limits<T>::digits10;
+  const int max_precision = std::numeric_limits<T>::max_digits10;
+  int length = 0;
+  for (int precision = min_precision; precision <= max_precision;
+       ++precision) {
+    length = std::snprintf(out, max_number_length, "%.*Lg", precision,
+                           static_cast<long double>(x));
+    // Some locales use a decimal comma.
+    for (int i = 0; i < length; ++i)
+      if (out[i] == ',')
+        out[i] = '.';
+    T y;
+    parse_float(out, y);
+    if (y == x)
+      break;
+  }
+  return out + length;
+#endif
+}
+} // namespace detail
+
+template <unsigned column_count, class quote_policy = no_quote_escape<','>,
+          class block_policy = default_block_size>
+class CSVWriter {
+private:
+  static const int block_len = block_policy::block_len;
+  static const int prefetch_count = block_policy::prefetch_count;
+#ifdef CSV_IO_NO_THREAD
+  detail::SynchronousWriter writer;
+#else
+  typename std::conditional<prefetch_count == 0, detail::SynchronousWriter,
+                            detail::AsynchronousWriter>::type writer;
+#endif
+  char *block;
+  int block_fill = 0;
+  // Where the row that is being written starts in the block, or -1 if no row
+  // is being written or a part of it has already been handed to the writer.
+  int row_begin = -1;
+
+  // Fields whose escaped form may exceed a block are escaped into this
+  // buffer and then copied into as many blocks as needed.
+  std::vector<char> long_field;
+
+  char file_name[error::max_file_name_length + 1];
+  unsigned file_line = 0;
+
+  void init(std::unique_ptr<ByteSinkBase> byte_sink) {
+    // One block is filled while up to prefetch_count blocks are written.
+    writer.init(std::move(byte_sink), block_len, prefetch_count + 1);
+    block = writer.get_block();
+  }
+
+  // Hands the block over without the row that is being written, which is
+  // moved to the front of the next block. Only a row that fills the whole
+  // block is handed over in part.
+  void write_block() {
+    int kept_begin = row_begin > 0 ? row_begin : block_fill;
+    writer.write_block(kept_begin);
+    const char *kept = block + kept_begin;
+    try {
+      block = writer.get_block();
+    } catch (...) {
+      // The failed writer no longer touches the handed over block, so it
+      // stays usable but its content is dropped.
+      block_fill = 0;
+      row_begin = -1;
+      throw;
+    }
+    block_fill -= kept_begin;
+    // The synchronous writer reuses its only block.
+    std::memmove(block, kept, block_fill);
+    row_begin = row_begin > 0 ? 0 : -1;
+  }
+
+  // Makes sure that at least byte_count <= block_len bytes are free.
+  char *reserve(int byte_count) {
+    while (block_len - block_fill < byte_count)
+      write_block();
+    return block + block_fill;
+  }
+
+  void append(const char *data, std::size_t byte_count) {
+    while (byte_count != 0) {
+      if (block_fill == block_len)
+        write_block();
+      std::size_t n = (std::min)(byte_count,
+                                 static_cast<std::size_t>(block_len - block_fill));
+      std::memcpy(block + block_fill, data, n);
+      block_fill += static_cast<int>(n);
+      data += n;
+      byte_count -= n;
+    }
+  }
+
+  void throw_unwritable_column_content(const char *begin, const char *end) {
+    error::unwritable_column_content err;
+    std::string content(begin, end);
+    err.set_column_content(content.c_str());
+    err.set_file_line(file_line + 1);
+    throw err;
+  }
+
+  void write_string(const char *begin, const char *end) {
+    std::size_t max_length =
+        quote_policy::get_max_escaped_length(end - begin);
+    if (max_length <= static_cast<std::size_t>(block_len)) {
+      char *out = reserve(static_cast<int>(max_length));
+      if (!quote_policy::escape(begin, end, out))
+        throw_unwritable_column_content(begin, end);
+      block_fill = static_cast<int>(out - block);
+    } else {
+      long_field.resize(max_length);
+      char *out = long_field.data();
+      if (!quote_policy::escape(begin, end, out))
+        throw_unwritable_column_content(begin, end);
+      append(long_field.data(), out - long_field.data());
+    }
+  }
+
+  void write_column(const char *x) { write_string(x, x + std::strlen(x)); }
+  void write_column(char *x) { write_string(x, x + std::strlen(x)); }
+  void write_column(const std::string &x) {
+    write_string(x.data(), x.data() + x.size());
+  }
+#ifdef CSV_IO_HAS_STRING_VIEW
+  void write_column(std::string_view x) {
+    write_string(x.data(), x.data() + x.size());
+  }
+#endif
+  void write_column(char x) { write_string(&x, &x + 1); }
+
+  // Numbers are formatted into the block if it can hold the longest one.
+  template <class F> void write_number(F format) {
+    if (detail::max_number_length <= block_len) {
+      char *out = reserve(detail::max_number_length);
+      block_fill = static_cast<int>(format(out) - block);
+    } else {
+      char buffer[detail::max_number_length];
+      append(buffer, format(buffer) - buffer);
+    }
+  }
+
+  template <class T> void write_integer(T x) {
+    write_number([&](char *out) { return detail::format_integer(x, out); });
+  }
+
+  void write_column(signed char x) { write_integer(x); }
+  void write_column(short x) { write_integer(x); }
+  void write_column(int x) { write_integer(x); }
+  void write_column(long x) { write_integer(x); }
+  void write_column(long long x) { write_integer(x); }
+  void write_column(unsigned char x) { write_integer(x); }
+  void write_column(unsigned short x) { write_integer(x); }
+  void write_column(unsigned x) { write_integer(x); }
+  void write_column(unsigned long x) { write_integer(x); }
+  void write_column(unsigned long long x) { write_integer(x); }
+
+  template <class T> void write_float(T x) {
+    // CSVReader does not read NaN and infinity.
+    if (x != x || x == std::numeric_limits<T>::infinity() ||
+        x == -std::numeric_limits<T>::infinity()) {
+      char buffer[detail::max_number_length];
+      throw_unwritable_column_content(buffer, detail::format_float(x, buffer));
+    }
+    write_number([&](char *out) { return detail::format_float(x, out); });
+  }
+
+  void write_column(float x) { write_float(x); }
+  void write_column(double x) { write_float(x); }
+  void write_column(long double x) { write_float(x); }
+
+  template <unsigned scale, class int_type>
+  void write_column(decimal<scale, int_type> x) {
+    write_number([&](char *out) { return detail::format_decimal(x, out); });
+  }
+
+  template <class T> void write_column(const T &) {
+    static_assert(sizeof(T) != sizeof(T),
+                  "Can not write this type. Only builtin integrals, floats, "
+                  "decimal, char, char*, const char*, std::string and "
+                  "std::string_view are supported");
+  }
+
+  void write_columns() {}
+
+  template <class T, class... ColType>
+  void write_columns(const T &x, const ColType &... cols) {
+    write_column(x);
+    char *out = reserve(1);
+    if (sizeof...(ColType) == 0)
+      *out = '\n';
+    else
+      *out = quote_policy::separator;
+    ++block_fill;
+    write_columns(cols...);
+  }
+
+  // Adds the file name to errors, including those of the writing thread.
+  template <class F> void decorate_errors(F f) {
+    try {
+      f();
+    } catch (error::with_file_name &err) {
+      err.set_file_name(file_name);
+      throw;
+    }
+  }
+
+public:
+  CSVWriter() = delete;
+  CSVWriter(const CSVWriter &) = delete;
+  CSVWriter &operator=(const CSVWriter &) = delete;
+
+  explicit CSVWriter(const char *file_name) {
+    set_file_name(file_name);
+    init(detail::create_file(file_name));
+  }
+
+  explicit CSVWriter(const std::string &file_name) {
+    set_file_name(file_name.c_str());
+    init(detail::create_file(file_name.c_str()));
+  }
+
+  CSVWriter(const char *file_name, std::unique_ptr<ByteSinkBase> byte_sink) {
+    set_file_name(file_name);
+    init(std::move(byte_sink));
+  }
+
+  CSVWriter(const std::string &file_name,
+            std::unique_ptr<ByteSinkBase> byte_sink) {
+    set_file_name(file_name.c_str());
+    init(std::move(byte_sink));
+  }
+
+  CSVWriter(const char *file_name, FILE *file) {
+    set_file_name(file_name);
+    init(std::unique_ptr<ByteSinkBase>(new detail::OwningStdIOByteSink(file)));
+  }
+
+  CSVWriter(const std::string &file_name, FILE *file) {
+    set_file_name(file_name.c_str());
+    init(std::unique_ptr<ByteSinkBase>(new detail::OwningStdIOByteSink(file)));
+  }
+
+  CSVWriter(const char *file_name, std::ostream &out) {
+    set_file_name(file_name);
+    init(std::unique_ptr<ByteSinkBase>(
+        new detail::NonOwningOStreamByteSink(out)));
+  }
+
+  CSVWriter(const std::string &file_name, std::ostream &out) {
+    set_file_name(file_name.c_str());
+    init(std::unique_ptr<ByteSinkBase>(
+        new detail::NonOwningOStreamByteSink(out)));
+  }
+
+  // Errors that happen while writing the last blocks are lost. Call flush
+  // before the destructor to see them.
+  ~CSVWriter() {
+    try {
+      flush();
+    } catch (...) {
+    }
+  }
+
+  void set_file_name(const std::string &file_name) {
+    set_file_name(file_name.c_str());
+  }
+
+  void set_file_name(const char *file_name) {
+    if (file_name != nullptr) {
+      strncpy(this->file_name, file_name, sizeof(this->file_name) - 1);
+      this->file_name[sizeof(this->file_name) - 1] = '\0';
+    } else {
+      this->file_name[0] = '\0';
+    }
   }
 
-  static void unescape(char *&col_begin, char *&col_end) {
-    if (col_end - col_begin >= 2) {
-      if (*col_begin == quote && *(col_end - 1) == quote) {
-        ++col_begin;
-        --col_end;
-        char *out = col_begin;
-        for (char *in = col_begin; in != col_end; ++in) {
-          if (*in == quote && (in + 1) != col_end && *(in + 1) == quote) {
-            ++in;
-          }
-          *out = *in;
-          ++out;
-        }
-        col_end = out;
-        *col_end = '\0';
+  const char *get_truncated_file_name() const { return file_name; }
+
+  // The number of lines written so far.
+  unsigned get_file_line() const { return file_line; }
+
+  template <class... ColNames> void write_header(const ColNames &... cols) {
+    static_assert(sizeof...(ColNames) >= column_count,
+                  "not enough column names specified");
+    static_assert(sizeof...(ColNames) <= column_count,
+                  "too many column names specified");
+    write_row(cols...);
+  }
+
+  template <class... ColType> void write_row(const ColType &... cols) {
+    static_assert(sizeof...(ColType) >= column_count,
+                  "not enough columns specified");
+    static_assert(sizeof...(ColType) <= column_count,
+                  "too many columns specified");
+    decorate_errors([&] {
+      row_begin = block_fill;
+      try {
+        write_columns(cols...);
+      } catch (error::unwritable_column_content &) {
+        // Drop the partial row unless a part of it has already been handed
+        // to the writer.
+        if (row_begin != -1)
+          block_fill = row_begin;
+        row_begin = -1;
+        throw;
+      } catch (...) {
+        row_begin = -1;
+        throw;
       }
-    }
+      row_begin = -1;
+    });
+    ++file_line;
+  }
+
+  // Hands the buffered rows to the byte sink and waits until they have been
+  // written.
+  void flush() {
+    decorate_errors([&] {
+      if (block_fill != 0)
+        write_block();
+      writer.flush();
+    });
   }
 };
 
-struct throw_on_overflow {
-  template <class T> static void on_overflow(T &) {
-    throw error::integer_overflow();
+////////////////////////////////////////////////////////////////////////////
+//                               Row Index                                //
+////////////////////////////////////////////////////////////////////////////
+
+namespace error {
+struct invalid_index_file : base, with_file_name {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  "The file \"%s\" is not a valid row index for this key type.",
+                  file_name);
   }
+};
+} // namespace error
 
-  template <class T> static void on_underflow(T &) {
-    throw error::integer_underflow();
+// Remembers the position of every rows_per_block-th row of a file and,
+// optionally, the smallest and largest key of the rows in between. Seeking
+// to a block allows to continue reading at any indexed row and skipping
+// blocks whose key range does not overlap a query.
+template <class key_type = long long> class RowIndex {
+  static_assert(std::is_arithmetic<key_type>::value,
+                "the key of a row index must be a number");
+
+public:
+  struct block {
+    file_position position;
+    unsigned long long first_row;
+    unsigned long long row_count;
+    key_type min_key;
+    key_type max_key;
+  };
+
+  explicit RowIndex(unsigned long long rows_per_block = 4096)
+      : rows_per_block(rows_per_block == 0 ? 1 : rows_per_block) {}
+
+  // Call after every read_row with the reader that read the row. Rows of a
+  // file must be added in order and either all or none with a key.
+  template <class Reader> void add_row(const Reader &r) {
+    assert(row_count == 0 || !has_key_values);
+    begin_row(r);
+  }
+
+  template <class Reader> void add_row(const Reader &r, key_type key) {
+    assert(row_count == 0 || has_key_values);
+    has_key_values = true;
+    block &b = begin_row(r);
+    if (b.row_count == 1) {
+      b.min_key = key;
+      b.max_key = key;
+    } else {
+      if (key < b.min_key)
+        b.min_key = key;
+      if (b.max_key < key)
+        b.max_key = key;
+    }
+  }
+
+  unsigned long long get_rows_per_block() const { return rows_per_block; }
+
+  unsigned long long get_row_count() const { return row_count; }
+
+  std::size_t get_block_count() const { return blocks.size(); }
+
+  const block &get_block(std::size_t i) const { return blocks[i]; }
+
+  bool has_keys() const { return has_key_values; }
+
+  void clear() {
+    blocks.clear();
+    row_count = 0;
+    has_key_values = false;
+  }
+
+  // Returns get_block_count() if the row is not in the index.
+  std::size_t find_block_of_row(unsigned long long row) const {
+    if (row >= row_count)
+      return blocks.size();
+    return static_cast<std::size_t>(row / rows_per_block);
+  }
+
+  // Returns the blocks that might contain keys between min_key and max_key,
+  // both included, in file order. Requires keys.
+  std::vector<std::size_t> find_blocks(key_type min_key,
+                                       key_type max_key) const {
+    assert(has_key_values || blocks.empty());
+    std::vector<std::size_t> found;
+    for (std::size_t i = 0; i < blocks.size(); ++i)
+      if (!(blocks[i].max_key < min_key) && !(max_key < blocks[i].min_key))
+        found.push_back(i);
+    return found;
+  }
+
+  // Makes the next read_row of r return the first row of block i.
+  template <class Reader> void seek_to_block(Reader &r, std::size_t i) const {
+    r.seek(blocks[i].position);
+  }
+
+  // Positions r such that the next read_row returns the row. The rows in
+  // front of it inside its block are read and dropped. Returns false if the
+  // row is not in the index.
+  template <class Reader>
+  bool seek_to_row(Reader &r, unsigned long long row) const {
+    std::size_t i = find_block_of_row(row);
+    if (i == blocks.size())
+      return false;
+    seek_to_block(r, i);
+    for (unsigned long long j = blocks[i].first_row; j < row; ++j)
+      r.skip_row();
+    return true;
+  }
+
+  // The file uses the byte order of the machine. It can only be loaded into
+  // a RowIndex with the same key type.
+  void save(const std::string &file_name) const { save(file_name.c_str()); }
+
+  void save(const char *file_name) const {
+    std::FILE *file = std::fopen(file_name, "wb");
+    if (file == nullptr) {
+      int x = errno;
+      error::can_not_open_file err;
+      err.set_errno(x);
+      err.set_file_name(file_name);
+      throw err;
+    }
+    bool ok = write_value(file, get_magic()) && write_value(file, get_key_tag()) &&
+              write_value(file, static_cast<std::uint32_t>(has_key_values)) &&
+              write_value(file, rows_per_block) &&
+              write_value(file, row_count) &&
+              write_value(file,
+                          static_cast<unsigned long long>(blocks.size()));
+    for (std::size_t i = 0; ok && i < blocks.size(); ++i) {
+      const block &b = blocks[i];
+      ok = write_value(file, b.position.byte_offset) &&
+           write_value(file, b.position.file_line) &&
+           write_value(file, b.first_row) && write_value(file, b.row_count) &&
+           write_value(file, b.min_key) && write_value(file, b.max_key);
+    }
+    int x = ok ? 0 : errno;
+    if (std::fclose(file) != 0 && ok) {
+      ok = false;
+      x = errno;
+    }
+    if (!ok) {
+      error::can_not_write_file err;
+      err.set_errno(x);
+      err.set_file_name(file_name);
+      throw err;
+    }
+  }
+
+  // Replaces the content of the index by the content of the file.
+  void load(const std::string &file_name) { load(file_name.c_str()); }
+
+  void load(const char *file_name) {
+    std::FILE *file = std::fopen(file_name, "rb");
+    if (file == nullptr) {
+      int x = errno;
+      error::can_not_open_file err;
+      err.set_errno(x);
+      err.set_file_name(file_name);
+      throw err;
+    }
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> file_closer(file,
+                                                                 &std::fclose);
+
+    std::uint64_t file_magic;
+    std::uint32_t key_tag, key_flag;
+    unsigned long long new_rows_per_block, new_row_count, block_count;
+    bool ok = read_value(file, file_magic) && file_magic == get_magic() &&
+              read_value(file, key_tag) && key_tag == get_key_tag() &&
+              read_value(file, key_flag) && key_flag <= 1 &&
+              read_value(file, new_rows_per_block) &&
+              new_rows_per_block != 0 && read_value(file, new_row_count) &&
+              read_value(file, block_count) &&
+              block_count ==
+                  (new_row_count + new_rows_per_block - 1) / new_rows_per_block;
+    std::vector<block> new_blocks;
+    for (unsigned long long i = 0; ok && i < block_count; ++i) {
+      block b;
+      ok = read_value(file, b.position.byte_offset) &&
+           read_value(file, b.position.file_line) &&
+           read_value(file, b.first_row) && read_value(file, b.row_count) &&
+           read_value(file, b.min_key) && read_value(file, b.max_key);
+      new_blocks.push_back(b);
+    }
+    if (!ok) {
+      error::invalid_index_file err;
+      err.set_file_name(file_name);
+      throw err;
+    }
+    blocks = std::move(new_blocks);
+    rows_per_block = new_rows_per_block;
+    row_count = new_row_count;
+    has_key_values = key_flag != 0;
+  }
+
+private:
+  unsigned long long rows_per_block;
+  unsigned long long row_count = 0;
+  bool has_key_values = false;
+  std::vector<block> blocks;
+
+  static std::uint64_t get_magic() {
+    return 0x3158444E49565343ull; // "CSVINDX1" on little endian machines
+  }
+
+  // Distinguishes key types of the same size.
+  static std::uint32_t get_key_tag() {
+    return static_cast<std::uint32_t>(sizeof(key_type)) |
+           (std::is_floating_point<key_type>::value ? 0x100u : 0u) |
+           (std::is_signed<key_type>::value ? 0x200u : 0u);
+  }
+
+  template <class Reader> block &begin_row(const Reader &r) {
+    if (row_count % rows_per_block == 0) {
+      block b;
+      b.position = r.get_line_position();
+      b.first_row = row_count;
+      b.row_count = 0;
+      b.min_key = key_type();
+      b.max_key = key_type();
+      blocks.push_back(b);
+    }
+    ++row_count;
+    block &b = blocks.back();
+    ++b.row_count;
+    return b;
+  }
+
+  template <class T> static bool write_value(std::FILE *file, const T &x) {
+    return std::fwrite(&x, sizeof(T), 1, file) == 1;
+  }
+
+  template <class T> static bool read_value(std::FILE *file, T &x) {
+    return std::fread(&x, sizeof(T), 1, file) == 1;
   }
 };
 
-struct ignore_overflow {
-  template <class T> static void on_overflow(T &) {}
+#ifndef CSV_IO_NO_THREAD
+////////////////////////////////////////////////////////////////////////////
+//                             Parallel CSV                               //
+////////////////////////////////////////////////////////////////////////////
 
-  template <class T> static void on_underflow(T &) {}
+namespace detail {
+template <std::size_t... I> struct index_sequence {};
+
+template <std::size_t N, std::size_t... I>
+struct make_index_sequence : make_index_sequence<N - 1, N - 1, I...> {};
+
+template <std::size_t... I> struct make_index_sequence<0, I...> {
+  typedef index_sequence<I...> type;
 };
 
-struct set_to_max_on_overflow {
-  template <class T> static void on_overflow(T &x) {
-    // using (std::numeric_limits<T>::max) instead of
-    // std::numeric_limits<T>::max to make code including windows.h with its max
-    // macro happy
-    x = (std::numeric_limits<T>::max)();
+class WorkerPool {
+public:
+  explicit WorkerPool(unsigned thread_count) : termination_requested(false) {
+    try {
+      for (unsigned i = 0; i < thread_count; ++i)
+        workers.emplace_back([this, i] {
+          std::unique_lock<std::mutex> guard(lock);
+          for (;;) {
+            task_available_condition.wait(guard, [&] {
+              return termination_requested || !tasks.empty();
+            });
+            if (termination_requested)
+              return;
+            std::function<void(unsigned)> task = std::move(tasks.front());
+            tasks.pop_front();
+            guard.unlock();
+            task(i);
+            guard.lock();
+          }
+        });
+    } catch (...) {
+      terminate();
+      throw;
+    }
+  }
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // The task gets the index of the worker thread that runs it. Tasks must not
+  // throw.
+  void submit(std::function<void(unsigned)> task) {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      tasks.push_back(std::move(task));
+    }
+    task_available_condition.notify_one();
+  }
+
+  // Tasks that have not yet been started are dropped.
+  ~WorkerPool() { terminate(); }
+
+private:
+  void terminate() {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      termination_requested = true;
+    }
+    task_available_condition.notify_all();
+    for (auto &worker : workers)
+      worker.join();
+    workers.clear();
+  }
+
+  std::vector<std::thread> workers;
+  std::deque<std::function<void(unsigned)>> tasks;
+  bool termination_requested;
+
+  std::mutex lock;
+  std::condition_variable task_available_condition;
+};
+} // namespace detail
+
+template <unsigned column_count, class trim_policy = trim_chars<' ', '\t'>,
+          class quote_policy = no_quote_escape<','>,
+          class overflow_policy = throw_on_overflow,
+          class comment_policy = no_comment>
+class ParallelCSVReader {
+private:
+  // A chunk consists of complete lines. There is always one spare byte behind
+  // data_end so that the last line can be null terminated.
+  struct Chunk {
+    std::unique_ptr<char[]> buffer;
+    char *data_begin;
+    char *data_end;
+    unsigned file_line; // file line of the line in front of data_begin
+  };
+
+  std::unique_ptr<ByteSourceBase> byte_source;
+  bool is_at_begin_of_input;
+  bool is_at_end_of_input;
+  std::vector<char> incomplete_line;
+  unsigned file_line;
+
+  Chunk header_chunk;
+  bool has_header_chunk;
+
+  char file_name[error::max_file_name_length + 1];
+
+  unsigned thread_count;
+  int chunk_size;
+  std::size_t max_line_length;
+
+  std::string column_names[column_count];
+  std::vector<int> col_order;
+
+  void init(std::unique_ptr<ByteSourceBase> arg_byte_source) {
+    byte_source = std::move(arg_byte_source);
+    is_at_begin_of_input = true;
+    is_at_end_of_input = false;
+    file_line = 0;
+    has_header_chunk = false;
+    thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0)
+      thread_count = 1;
+    chunk_size = 1 << 22;
+    max_line_length = default_block_size::block_len - 1;
+    col_order.resize(column_count);
+    for (unsigned i = 0; i < column_count; ++i)
+      col_order[i] = i;
+    for (unsigned i = 1; i <= column_count; ++i)
+      column_names[i - 1] = "col" + std::to_string(i);
+  }
+
+  bool read_chunk(Chunk &chunk) {
+    if (has_header_chunk) {
+      chunk = std::move(header_chunk);
+      has_header_chunk = false;
+      return true;
+    }
+
+    std::size_t capacity = chunk_size;
+    if (incomplete_line.size() >= capacity)
+      capacity = 2 * incomplete_line.size();
+    std::unique_ptr<char[]> buffer(new char[capacity + 1]);
+    std::size_t size = incomplete_line.size();
+    if (size != 0)
+      std::memcpy(buffer.get(), incomplete_line.data(), size);
+    incomplete_line.clear();
+    // The bytes in front of search_begin contain no newline.
+    std::size_t search_begin = size;
+
+    for (;;) {
+      while (size != capacity && !is_at_end_of_input) {
+        int read_byte_count = byte_source->read(
+            buffer.get() + size,
+            static_cast<int>(std::min<std::size_t>(capacity - size, chunk_size)));
+        if (read_byte_count == 0)
+          is_at_end_of_input = true;
+        size += read_byte_count;
+      }
+      if (is_at_end_of_input)
+        break;
+
+      std::size_t chunk_end = size;
+      while (chunk_end != search_begin && buffer[chunk_end - 1] != '\n')
+        --chunk_end;
+      if (chunk_end != search_begin) {
+        incomplete_line.assign(buffer.get() + chunk_end, buffer.get() + size);
+        size = chunk_end;
+        break;
+      }
+
+      // Not a single line fits into the chunk.
+      if (size > max_line_length)
+        throw_line_length_limit_exceeded(file_line + 1);
+      search_begin = size;
+      capacity *= 2;
+      std::unique_ptr<char[]> larger_buffer(new char[capacity + 1]);
+      std::memcpy(larger_buffer.get(), buffer.get(), size);
+      buffer = std::move(larger_buffer);
+    }
+
+    if (size == 0)
+      return false;
+
+    chunk.buffer = std::move(buffer);
+    chunk.data_begin = chunk.buffer.get();
+    chunk.data_end = chunk.buffer.get() + size;
+    chunk.file_line = file_line;
+
+    // Ignore UTF-8 BOM
+    if (is_at_begin_of_input) {
+      is_at_begin_of_input = false;
+      if (size >= 3 && chunk.data_begin[0] == '\xEF' &&
+          chunk.data_begin[1] == '\xBB' && chunk.data_begin[2] == '\xBF')
+        chunk.data_begin += 3;
+    }
+
+    file_line += std::count(chunk.data_begin, chunk.data_end, '\n');
+    if (chunk.data_end[-1] != '\n')
+      ++file_line;
+
+    return true;
+  }
+
+  void throw_line_length_limit_exceeded(unsigned line) const {
+    error::line_length_limit_exceeded err;
+    err.set_file_name(file_name);
+    err.set_file_line(line);
+    throw err;
+  }
+
+  // line is the file line of the returned line.
+  char *next_line(char *&data_begin, char *data_end, unsigned line) const {
+    if (data_begin == data_end)
+      return nullptr;
+
+    char *line_begin = data_begin;
+    char *line_end = static_cast<char *>(
+        std::memchr(line_begin, '\n', data_end - line_begin));
+    if (line_end == nullptr) {
+      // some files are missing the newline at the end of the
+      // last line
+      line_end = data_end;
+      data_begin = data_end;
+    } else {
+      data_begin = line_end + 1;
+    }
+    if (static_cast<std::size_t>(line_end - line_begin) > max_line_length)
+      throw_line_length_limit_exceeded(line);
+    *line_end = '\0';
+
+    // handle windows \r\n-line breaks
+    if (line_end != line_begin && *(line_end - 1) == '\r')
+      *(line_end - 1) = '\0';
+
+    return line_begin;
+  }
+
+  template <class... ColNames>
+  void set_column_names(std::string s, ColNames... cols) {
+    column_names[column_count - sizeof...(ColNames) - 1] = std::move(s);
+    set_column_names(std::forward<ColNames>(cols)...);
+  }
+
+  void set_column_names() {}
+
+  void parse_helper(char **, std::size_t) const {}
+
+  template <class T, class... ColType>
+  void parse_helper(char **row, std::size_t r, T &t, ColType &... cols) const {
+    if (row[r]) {
+      try {
+        try {
+          ::io::detail::parse<overflow_policy>(row[r], t);
+        } catch (error::with_column_content &err) {
+          err.set_column_content(row[r]);
+          throw;
+        }
+      } catch (error::with_column_name &err) {
+        err.set_column_name(column_names[r].c_str());
+        throw;
+      }
+    }
+    parse_helper(row, r + 1, cols...);
+  }
+
+  template <class... ColType, std::size_t... I>
+  void parse_row(char **row, std::tuple<ColType...> &cols,
+                 detail::index_sequence<I...>) const {
+    parse_helper(row, 0, std::get<I>(cols)...);
+  }
+
+  // Calls row_parsed() after every row of the chunk has been parsed into
+  // cols.
+  template <class... ColType, class RowParsed>
+  void parse_chunk(Chunk &chunk, std::tuple<ColType...> &cols,
+                   RowParsed row_parsed) const {
+    char *row[column_count];
+    std::fill(row, row + column_count, nullptr);
+    unsigned chunk_file_line = chunk.file_line;
+    typedef detail::quote_fast_path<quote_policy> fast_path;
+    bool may_contain_quote =
+        !fast_path::is_enabled ||
+        std::memchr(chunk.data_begin, fast_path::quote_char,
+                    chunk.data_end - chunk.data_begin) != nullptr;
+    try {
+      try {
+        for (;;) {
+          ++chunk_file_line;
+          char *line =
+              next_line(chunk.data_begin, chunk.data_end, chunk_file_line);
+          if (line == nullptr)
+            break;
+          if (comment_policy::is_comment(line))
+            continue;
+          detail::parse_line<trim_policy, quote_policy>(line, row, col_order,
+                                                        may_contain_quote);
+          parse_row(row, cols,
+                    typename detail::make_index_sequence<sizeof...(
+                        ColType)>::type());
+          row_parsed();
+        }
+      } catch (error::with_file_name &err) {
+        err.set_file_name(file_name);
+        throw;
+      }
+    } catch (error::with_file_line &err) {
+      err.set_file_line(chunk_file_line);
+      throw;
+    }
   }
 
-  template <class T> static void on_underflow(T &x) {
-    x = (std::numeric_limits<T>::min)();
+  template <class RowHandler, class... ColType, std::size_t... I>
+  static void call_row_handler(RowHandler &handler,
+                               std::tuple<ColType...> &cols,
+                               detail::index_sequence<I...>) {
+    handler(std::get<I>(cols)...);
   }
-};
-
-namespace detail {
-template <class quote_policy>
-void chop_next_column(char *&line, char *&col_begin, char *&col_end) {
-  assert(line != nullptr);
 
-  col_begin = line;
-  // the col_begin + (... - col_begin) removes the constness
-  col_end =
-      col_begin + (quote_policy::find_next_column_end(col_begin) - col_begin);
-
-  if (*col_end == '\0') {
-    line = nullptr;
-  } else {
-    *col_end = '\0';
-    line = col_end + 1;
+  template <class RowHandler, class... ColType, std::size_t... I>
+  static void call_row_handler(RowHandler &handler, unsigned worker,
+                               std::tuple<ColType...> &cols,
+                               detail::index_sequence<I...>) {
+    handler(worker, std::get<I>(cols)...);
   }
-}
-
-template <class trim_policy, class quote_policy>
-void parse_line(char *line, char **sorted_col,
-                const std::vector<int> &col_order) {
-  for (int i : col_order) {
-    if (line == nullptr)
-      throw ::io::error::too_few_columns();
-    char *col_begin, *col_end;
-    chop_next_column<quote_policy>(line, col_begin, col_end);
 
-    if (i != -1) {
-      trim_policy::trim(col_begin, col_end);
-      quote_policy::unescape(col_begin, col_end);
+public:
+  ParallelCSVReader() = delete;
+  ParallelCSVReader(const ParallelCSVReader &) = delete;
+  ParallelCSVReader &operator=(const ParallelCSVReader &) = delete;
 
-      sorted_col[i] = col_begin;
-    }
+  explicit ParallelCSVReader(const std::string &file_name) {
+    set_file_name(file_name);
+    init(detail::open_file(file_name.c_str()));
   }
-  if (line != nullptr)
-    throw ::io::error::too_many_columns();
-}
-
-template <unsigned column_count, class trim_policy, class quote_policy>
-void parse_header_line(char *line, std::vector<int> &col_order,
-                       const std::string *col_name,
-                       ignore_column ignore_policy) {
-  col_order.clear();
 
-  bool found[column_count];
-  std::fill(found, found + column_count, false);
-  while (line) {
-    char *col_begin, *col_end;
-    chop_next_column<quote_policy>(line, col_begin, col_end);
+  ParallelCSVReader(const std::string &file_name,
+                    std::unique_ptr<ByteSourceBase> byte_source) {
+    set_file_name(file_name);
+    init(std::move(byte_source));
+  }
 
-    trim_policy::trim(col_begin, col_end);
-    quote_policy::unescape(col_begin, col_end);
+  ParallelCSVReader(const std::string &file_name, const char *data_begin,
+                    const char *data_end) {
+    set_file_name(file_name);
+    init(std::unique_ptr<ByteSourceBase>(new detail::NonOwningStringByteSource(
+        data_begin, data_end - data_begin)));
+  }
 
-    for (unsigned i = 0; i < column_count; ++i)
-      if (col_begin == col_name[i]) {
-        if (found[i]) {
-          error::duplicated_column_in_header err;
-          err.set_column_name(col_begin);
-          throw err;
-        }
-        found[i] = true;
-        col_order.push_back(i);
-        col_begin = 0;
-        break;
-      }
-    if (col_begin) {
-      if (ignore_policy & ::io::ignore_extra_column)
-        col_order.push_back(-1);
-      else {
-        error::extra_column_in_header err;
-        err.set_column_name(col_begin);
-        throw err;
-      }
-    }
+  ParallelCSVReader(const std::string &file_name, FILE *file) {
+    set_file_name(file_name);
+    init(std::unique_ptr<ByteSourceBase>(
+        new detail::OwningStdIOByteSourceBase(file)));
   }
-  if (!(ignore_policy & ::io::ignore_missing_column)) {
-    for (unsigned i = 0; i < column_count; ++i) {
-      if (!found[i]) {
-        error::missing_column_in_header err;
-        err.set_column_name(col_name[i].c_str());
-        throw err;
-      }
-    }
+
+  ParallelCSVReader(const std::string &file_name, std::istream &in) {
+    set_file_name(file_name);
+    init(std::unique_ptr<ByteSourceBase>(
+        new detail::NonOwningIStreamByteSource(in)));
   }
-}
 
-template <class overflow_policy> void parse(char *col, char &x) {
-  if (!*col)
-    throw error::invalid_single_character();
-  x = *col;
-  ++col;
-  if (*col)
-    throw error::invalid_single_character();
-}
+  void set_thread_count(unsigned count) {
+    thread_count = count == 0 ? 1 : count;
+  }
 
-template <class overflow_policy> void parse(char *col, std::string &x) {
-  x = col;
-}
+  unsigned get_thread_count() const { return thread_count; }
 
-template <class overflow_policy> void parse(char *col, const char *&x) {
-  x = col;
-}
+  // Lines longer than a chunk are supported, the chunk grows as needed.
+  void set_chunk_size(int byte_count) {
+    chunk_size = byte_count < 1 ? 1 : byte_count;
+  }
 
-template <class overflow_policy> void parse(char *col, char *&x) { x = col; }
+  int get_chunk_size() const { return chunk_size; }
 
-template <class overflow_policy, class T>
-void parse_unsigned_integer(const char *col, T &x) {
-  x = 0;
-  while (*col != '\0') {
-    if ('0' <= *col && *col <= '9') {
-      T y = *col - '0';
-      if (x > ((std::numeric_limits<T>::max)() - y) / 10) {
-        overflow_policy::on_overflow(x);
-        return;
-      }
-      x = 10 * x + y;
-    } else
-      throw error::no_digit();
-    ++col;
+  // Longer lines throw error::line_length_limit_exceeded as for LineReader.
+  void set_max_line_length(std::size_t max_line_length) {
+    this->max_line_length = max_line_length;
   }
-}
 
-template <class overflow_policy> void parse(char *col, unsigned char &x) {
-  parse_unsigned_integer<overflow_policy>(col, x);
-}
-template <class overflow_policy> void parse(char *col, unsigned short &x) {
-  parse_unsigned_integer<overflow_policy>(col, x);
-}
-template <class overflow_policy> void parse(char *col, unsigned int &x) {
-  parse_unsigned_integer<overflow_policy>(col, x);
-}
-template <class overflow_policy> void parse(char *col, unsigned long &x) {
-  parse_unsigned_integer<overflow_policy>(col, x);
-}
-template <class overflow_policy> void parse(char *col, unsigned long long &x) {
-  parse_unsigned_integer<overflow_policy>(col, x);
-}
+  std::size_t get_max_line_length() const { return max_line_length; }
 
-template <class overflow_policy, class T>
-void parse_signed_integer(const char *col, T &x) {
-  if (*col == '-') {
-    ++col;
+  template <class... ColNames>
+  void read_header(ignore_column ignore_policy, ColNames... cols) {
+    static_assert(sizeof...(ColNames) >= column_count,
+                  "not enough column names specified");
+    static_assert(sizeof...(ColNames) <= column_count,
+                  "too many column names specified");
+    try {
+      set_column_names(std::forward<ColNames>(cols)...);
 
-    x = 0;
-    while (*col != '\0') {
-      if ('0' <= *col && *col <= '9') {
-        T y = *col - '0';
-        if (x < ((std::numeric_limits<T>::min)() + y) / 10) {
-          overflow_policy::on_underflow(x);
-          return;
+      char *line = nullptr;
+      while (line == nullptr) {
+        if (!has_header_chunk) {
+          if (!read_chunk(header_chunk))
+            throw error::header_missing();
+          has_header_chunk = true;
         }
-        x = 10 * x - y;
-      } else
-        throw error::no_digit();
-      ++col;
+        while ((line = next_line(header_chunk.data_begin,
+                                 header_chunk.data_end,
+                                 header_chunk.file_line + 1)) != nullptr) {
+          ++header_chunk.file_line;
+          if (!comment_policy::is_comment(line))
+            break;
+        }
+        if (line == nullptr)
+          has_header_chunk = false;
+      }
+
+      detail::parse_header_line<column_count, trim_policy, quote_policy>(
+          line, col_order, column_names, ignore_policy);
+    } catch (error::with_file_name &err) {
+      err.set_file_name(file_name);
+      throw;
     }
-    return;
-  } else if (*col == '+')
-    ++col;
-  parse_unsigned_integer<overflow_policy>(col, x);
-}
+  }
 
-template <class overflow_policy> void parse(char *col, signed char &x) {
-  parse_signed_integer<overflow_policy>(col, x);
-}
-template <class overflow_policy> void parse(char *col, signed short &x) {
-  parse_signed_integer<overflow_policy>(col, x);
-}
-template <class overflow_policy> void parse(char *col, signed int &x) {
-  parse_signed_integer<overflow_policy>(col, x);
-}
-template <class overflow_policy> void parse(char *col, signed long &x) {
-  parse_signed_integer<overflow_policy>(col, x);
-}
-template <class overflow_policy> void parse(char *col, signed long long &x) {
-  parse_signed_integer<overflow_policy>(col, x);
-}
+  template <class... ColNames> void set_header(ColNames... cols) {
+    static_assert(sizeof...(ColNames) >= column_count,
+                  "not enough column names specified");
+    static_assert(sizeof...(ColNames) <= column_count,
+                  "too many column names specified");
+    set_column_names(std::forward<ColNames>(cols)...);
+    col_order.resize(column_count);
+    for (unsigned i = 0; i < column_count; ++i)
+      col_order[i] = i;
+  }
 
-template <class T> void parse_float(const char *col, T &x) {
-  bool is_neg = false;
-  if (*col == '-') {
-    is_neg = true;
-    ++col;
-  } else if (*col == '+')
-    ++col;
+  bool has_column(const std::string &name) const {
+    return col_order.end() !=
+           std::find(col_order.begin(), col_order.end(),
+                     std::find(std::begin(column_names), std::end(column_names),
+                               name) -
+                         std::begin(column_names));
+  }
 
-  x = 0;
-  while ('0' <= *col && *col <= '9') {
-    int y = *col - '0';
-    x *= 10;
-    x += y;
-    ++col;
+  void set_file_name(const std::string &file_name) {
+    set_file_name(file_name.c_str());
   }
 
-  if (*col == '.' || *col == ',') {
-    ++col;
-    T pos = 1;
-    while ('0' <= *col && *col <= '9') {
-      pos /= 10;
-      int y = *col - '0';
-      ++col;
-      x += y * pos;
+  void set_file_name(const char *file_name) {
+    if (file_name != nullptr) {
+      strncpy(this->file_name, file_name, sizeof(this->file_name) - 1);
+      this->file_name[sizeof(this->file_name) - 1] = '\0';
+    } else {
+      this->file_name[0] = '\0';
     }
   }
 
-  if (*col == 'e' || *col == 'E') {
-    ++col;
-    int e;
-
-    parse_signed_integer<set_to_max_on_overflow>(col, e);
+  const char *get_truncated_file_name() const { return file_name; }
 
-    if (e != 0) {
-      T base;
-      if (e < 0) {
-        base = T(0.1);
-        e = -e;
-      } else {
-        base = T(10);
+  // Parses all remaining rows on the worker threads and calls
+  // handler(col1, col2, ...) for every row in file order on the calling
+  // thread.
+  template <class... ColType, class RowHandler>
+  void for_each_row(RowHandler handler) {
+    static_assert(sizeof...(ColType) >= column_count,
+                  "not enough columns specified");
+    static_assert(sizeof...(ColType) <= column_count,
+                  "too many columns specified");
+    typedef std::tuple<ColType...> Row;
+    typedef typename detail::make_index_sequence<sizeof...(ColType)>::type
+        RowIndices;
+
+    struct Job {
+      Chunk chunk;
+      std::vector<Row> rows;
+      std::exception_ptr error;
+      bool is_done;
+    };
+
+    // The ring of jobs bounds the number of chunks that are parsed but not
+    // yet handled.
+    std::vector<Job> jobs(2 * thread_count);
+    std::mutex lock;
+    std::condition_variable job_done_condition;
+    // Must be destroyed first as the workers reference the jobs.
+    detail::WorkerPool workers(thread_count);
+
+    unsigned long long next_job_to_submit = 0;
+    unsigned long long next_job_to_handle = 0;
+    for (;;) {
+      while (!is_at_end_of_input || has_header_chunk) {
+        if (next_job_to_submit - next_job_to_handle == jobs.size())
+          break;
+        Job &job = jobs[next_job_to_submit % jobs.size()];
+        if (!read_chunk(job.chunk))
+          break;
+        job.rows.clear();
+        job.error = nullptr;
+        job.is_done = false;
+        Job *job_ptr = &job;
+        workers.submit([this, job_ptr, &lock, &job_done_condition](unsigned) {
+          try {
+            Row cols;
+            parse_chunk(job_ptr->chunk, cols,
+                        [&] { job_ptr->rows.push_back(cols); });
+          } catch (...) {
+            job_ptr->error = std::current_exception();
+          }
+          std::unique_lock<std::mutex> guard(lock);
+          job_ptr->is_done = true;
+          job_done_condition.notify_all();
+        });
+        ++next_job_to_submit;
       }
 
-      while (e != 1) {
-        if ((e & 1) == 0) {
-          base = base * base;
-          e >>= 1;
-        } else {
-          x *= base;
-          --e;
-        }
+      if (next_job_to_handle == next_job_to_submit)
+        break;
+
+      Job &job = jobs[next_job_to_handle % jobs.size()];
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        job_done_condition.wait(guard, [&] { return job.is_done; });
       }
-      x *= base;
+      // The rows in front of a broken line are handled just as CSVReader
+      // would have returned them before throwing.
+      for (auto &row : job.rows)
+        call_row_handler(handler, row, RowIndices());
+      if (job.error)
+        std::rethrow_exception(job.error);
+      job.rows.clear();
+      job.chunk.buffer.reset();
+      ++next_job_to_handle;
     }
-  } else {
-    if (*col != '\0')
-      throw error::no_digit();
   }
 
-  if (is_neg)
-    x = -x;
-}
-
-template <class overflow_policy> void parse(char *col, float &x) {
-  parse_float(col, x);
-}
-template <class overflow_policy> void parse(char *col, double &x) {
-  parse_float(col, x);
-}
-template <class overflow_policy> void parse(char *col, long double &x) {
-  parse_float(col, x);
-}
+  // Parses all remaining rows and calls handler(worker, col1, col2, ...) for
+  // every row on the worker threads. worker is the index of the thread in
+  // [0, get_thread_count()) and can be used to index per thread state. Rows
+  // are not handled in file order.
+  template <class... ColType, class RowHandler>
+  void for_each_row_unordered(RowHandler handler) {
+    static_assert(sizeof...(ColType) >= column_count,
+                  "not enough columns specified");
+    static_assert(sizeof...(ColType) <= column_count,
+                  "too many columns specified");
+    typedef std::tuple<ColType...> Row;
+    typedef typename detail::make_index_sequence<sizeof...(ColType)>::type
+        RowIndices;
+
+    std::size_t running_job_count = 0;
+    // If several chunks fail then the error of the first one in the file is
+    // reported, i.e., the same error as CSVReader would have thrown.
+    std::exception_ptr error;
+    unsigned long long error_chunk_index = 0;
+    unsigned long long next_chunk_index = 0;
+    std::mutex lock;
+    std::condition_variable job_done_condition;
+    // Must be destroyed first as the workers reference the locals above.
+    detail::WorkerPool workers(thread_count);
+
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        job_done_condition.wait(guard, [&] {
+          return running_job_count < 2 * thread_count || error;
+        });
+        if (error)
+          break;
+      }
 
-template <class overflow_policy, class T> void parse(char *col, T &x) {
-  // Mute unused variable compiler warning
-  (void)col;
-  (void)x;
-  // GCC evaluates "false" when reading the template and
-  // "sizeof(T)!=sizeof(T)" only when instantiating it. This is why
-  // this strange construct is used.
-  static_assert(sizeof(T) != sizeof(T),
-                "Can not parse this type. Only builtin integrals, floats, "
-                "char, char*, const char* and std::string are supported");
-}
+      std::shared_ptr<Chunk> chunk(new Chunk);
+      if (!read_chunk(*chunk))
+        break;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        ++running_job_count;
+      }
+      unsigned long long chunk_index = next_chunk_index++;
+      workers.submit([this, chunk, chunk_index, &handler, &running_job_count,
+                      &error, &error_chunk_index, &lock,
+                      &job_done_condition](unsigned worker) {
+        std::exception_ptr job_error;
+        try {
+          Row cols;
+          parse_chunk(*chunk, cols, [&] {
+            call_row_handler(handler, worker, cols, RowIndices());
+          });
+        } catch (...) {
+          job_error = std::current_exception();
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        if (job_error && (!error || chunk_index < error_chunk_index)) {
+          error = job_error;
+          error_chunk_index = chunk_index;
+        }
+        --running_job_count;
+        job_done_condition.notify_all();
+      });
+    }
 
-} // namespace detail
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      job_done_condition.wait(guard, [&] { return running_job_count == 0; });
+    }
+    if (error)
+      std::rethrow_exception(error);
+  }
+};
 
+// Reads many files with the same columns, for example the parts of a table,
+// on a shared pool of threads. Every file is read by its own CSVReader that
+// does not start a reading thread, so the number of threads does not depend
+// on the number of files.
 template <unsigned column_count, class trim_policy = trim_chars<' ', '\t'>,
           class quote_policy = no_quote_escape<','>,
           class overflow_policy = throw_on_overflow,
-          class comment_policy = no_comment>
-class CSVReader {
+          class comment_policy = no_comment,
+          class block_policy = default_block_size>
+class ShardedCSVReader {
+public:
+  typedef CSVReader<column_count, trim_policy, quote_policy, overflow_policy,
+                    comment_policy, block_size<block_policy::block_len, 0>>
+      shard_reader_type;
+
 private:
-  LineReader in;
+  std::vector<std::string> file_names;
+  unsigned thread_count;
+  std::size_t max_line_length = block_policy::block_len - 1;
 
-  char *row[column_count];
+  enum class header_mode { none, read, set };
+  header_mode header = header_mode::none;
+  ignore_column header_ignore_policy = ignore_no_column;
   std::string column_names[column_count];
 
-  std::vector<int> col_order;
+  // Rows are handed from the workers to for_each_row in batches of this
+  // size. Every file in flight buffers at most max_batch_count batches.
+  static const std::size_t batch_row_count = 1024;
+  static const std::size_t max_batch_count = 4;
+
+  template <std::size_t... I>
+  void prepare_shard(shard_reader_type &in, detail::index_sequence<I...>) const {
+    in.set_max_line_length(max_line_length);
+    if (header == header_mode::read)
+      in.read_header(header_ignore_policy, column_names[I]...);
+    else if (header == header_mode::set)
+      in.set_header(column_names[I]...);
+  }
+
+  void prepare_shard(shard_reader_type &in) const {
+    prepare_shard(in,
+                  typename detail::make_index_sequence<column_count>::type());
+  }
 
   template <class... ColNames>
   void set_column_names(std::string s, ColNames... cols) {
@@ -1068,45 +6198,69 @@ private:
 
   void set_column_names() {}
 
-public:
-  CSVReader() = delete;
-  CSVReader(const CSVReader &) = delete;
-  CSVReader &operator=(const CSVReader &);
+  template <class... ColType, std::size_t... I>
+  static bool read_row(shard_reader_type &in, std::tuple<ColType...> &cols,
+                       detail::index_sequence<I...>) {
+    return in.read_row(std::get<I>(cols)...);
+  }
 
-  template <class... Args>
-  explicit CSVReader(Args &&... args) : in(std::forward<Args>(args)...) {
-    std::fill(row, row + column_count, nullptr);
-    col_order.resize(column_count);
-    for (unsigned i = 0; i < column_count; ++i)
-      col_order[i] = i;
+  template <class RowHandler, class... ColType, std::size_t... I>
+  static void call_row_handler(RowHandler &handler,
+                               std::tuple<ColType...> &cols,
+                               detail::index_sequence<I...>) {
+    handler(std::get<I>(cols)...);
+  }
+
+  template <class RowHandler, class... ColType, std::size_t... I>
+  static void call_row_handler(RowHandler &handler, unsigned worker,
+                               std::tuple<ColType...> &cols,
+                               detail::index_sequence<I...>) {
+    handler(worker, std::get<I>(cols)...);
+  }
+
+public:
+  ShardedCSVReader() = delete;
+  ShardedCSVReader(const ShardedCSVReader &) = delete;
+  ShardedCSVReader &operator=(const ShardedCSVReader &) = delete;
+
+  explicit ShardedCSVReader(std::vector<std::string> file_names)
+      : file_names(std::move(file_names)) {
+    thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0)
+      thread_count = 1;
     for (unsigned i = 1; i <= column_count; ++i)
       column_names[i - 1] = "col" + std::to_string(i);
   }
 
-  char *next_line() { return in.next_line(); }
+  void set_thread_count(unsigned count) {
+    thread_count = count == 0 ? 1 : count;
+  }
 
+  unsigned get_thread_count() const { return thread_count; }
+
+  std::size_t get_shard_count() const { return file_names.size(); }
+
+  const std::string &get_shard_file_name(std::size_t shard) const {
+    return file_names[shard];
+  }
+
+  void set_max_line_length(std::size_t max_line_length) {
+    this->max_line_length = max_line_length;
+  }
+
+  std::size_t get_max_line_length() const { return max_line_length; }
+
+  // The header of every file is read and checked against the column names
+  // when the file is opened. Errors are thrown by the for_each functions.
   template <class... ColNames>
   void read_header(ignore_column ignore_policy, ColNames... cols) {
     static_assert(sizeof...(ColNames) >= column_count,
                   "not enough column names specified");
     static_assert(sizeof...(ColNames) <= column_count,
                   "too many column names specified");
-    try {
-      set_column_names(std::forward<ColNames>(cols)...);
-
-      char *line;
-      do {
-        line = in.next_line();
-        if (!line)
-          throw error::header_missing();
-      } while (comment_policy::is_comment(line));
-
-      detail::parse_header_line<column_count, trim_policy, quote_policy>(
-          line, col_order, column_names, ignore_policy);
-    } catch (error::with_file_name &err) {
-      err.set_file_name(in.get_truncated_file_name());
-      throw;
-    }
+    set_column_names(std::forward<ColNames>(cols)...);
+    header = header_mode::read;
+    header_ignore_policy = ignore_policy;
   }
 
   template <class... ColNames> void set_header(ColNames... cols) {
@@ -1115,85 +6269,766 @@ public:
     static_assert(sizeof...(ColNames) <= column_count,
                   "too many column names specified");
     set_column_names(std::forward<ColNames>(cols)...);
-    std::fill(row, row + column_count, nullptr);
-    col_order.resize(column_count);
-    for (unsigned i = 0; i < column_count; ++i)
-      col_order[i] = i;
+    header = header_mode::set;
   }
 
-  bool has_column(const std::string &name) const {
-    return col_order.end() !=
-           std::find(col_order.begin(), col_order.end(),
-                     std::find(std::begin(column_names), std::end(column_names),
-                               name) -
-                         std::begin(column_names));
+  // Calls handler(worker, shard, in) for every file on the worker threads.
+  // in is a shard_reader_type of which the header was already read. worker
+  // is the index of the thread in [0, get_thread_count()). If several files
+  // fail then the error of the first one in the list is thrown, after the
+  // files that were being read are done. No further files are started after
+  // an error.
+  template <class ShardHandler> void for_each_shard(ShardHandler handler) {
+    std::size_t running_job_count = 0;
+    std::exception_ptr error;
+    std::size_t error_shard = 0;
+    std::mutex lock;
+    std::condition_variable job_done_condition;
+    // Must be destroyed first as the workers reference the locals above.
+    detail::WorkerPool workers(thread_count);
+
+    for (std::size_t shard = 0; shard < file_names.size(); ++shard) {
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        job_done_condition.wait(guard, [&] {
+          return running_job_count < thread_count || error;
+        });
+        if (error)
+          break;
+        ++running_job_count;
+      }
+      workers.submit([this, shard, &handler, &running_job_count, &error,
+                      &error_shard, &lock,
+                      &job_done_condition](unsigned worker) {
+        std::exception_ptr job_error;
+        try {
+          shard_reader_type in(file_names[shard]);
+          prepare_shard(in);
+          handler(worker, shard, in);
+        } catch (...) {
+          job_error = std::current_exception();
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        if (job_error && (!error || shard < error_shard)) {
+          error = job_error;
+          error_shard = shard;
+        }
+        --running_job_count;
+        job_done_condition.notify_all();
+      });
+    }
+
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      job_done_condition.wait(guard, [&] { return running_job_count == 0; });
+    }
+    if (error)
+      std::rethrow_exception(error);
   }
 
-  void set_file_name(const std::string &file_name) {
-    in.set_file_name(file_name);
+  // Parses all rows on the worker threads and calls handler(col1, col2, ...)
+  // for every row on the calling thread, file after file in the order of the
+  // list. Up to get_thread_count() files are parsed ahead. The columns must
+  // not be char* as the lines are gone when the row is handled.
+  template <class... ColType, class RowHandler>
+  void for_each_row(RowHandler handler) {
+    static_assert(sizeof...(ColType) >= column_count,
+                  "not enough columns specified");
+    static_assert(sizeof...(ColType) <= column_count,
+                  "too many columns specified");
+    typedef std::tuple<ColType...> Row;
+    typedef typename detail::make_index_sequence<sizeof...(ColType)>::type
+        RowIndices;
+
+    struct Job {
+      std::deque<std::vector<Row>> batches;
+      std::exception_ptr error;
+      bool is_done;
+    };
+
+    // The file with index i uses jobs[i % thread_count].
+    std::vector<Job> jobs(thread_count);
+    std::mutex lock;
+    std::condition_variable batch_condition;
+    bool is_cancelled = false;
+    // Must be destroyed first as the workers reference the locals above.
+    detail::WorkerPool workers(thread_count);
+    // Releases the workers that wait for room if the handler throws.
+    struct Canceller {
+      std::mutex &lock;
+      std::condition_variable &batch_condition;
+      bool &is_cancelled;
+      ~Canceller() {
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          is_cancelled = true;
+        }
+        batch_condition.notify_all();
+      }
+    } canceller{lock, batch_condition, is_cancelled};
+
+    std::size_t next_shard_to_submit = 0;
+    for (std::size_t shard = 0; shard < file_names.size(); ++shard) {
+      for (; next_shard_to_submit < file_names.size() &&
+             next_shard_to_submit < shard + thread_count;
+           ++next_shard_to_submit) {
+        std::size_t submitted_shard = next_shard_to_submit;
+        Job *job = &jobs[submitted_shard % thread_count];
+        job->batches.clear();
+        job->error = nullptr;
+        job->is_done = false;
+        workers.submit([this, job, submitted_shard, &lock, &batch_condition,
+                        &is_cancelled](unsigned) {
+          try {
+            shard_reader_type in(file_names[submitted_shard]);
+            prepare_shard(in);
+            Row cols;
+            bool is_at_end = false;
+            while (!is_at_end) {
+              std::vector<Row> batch;
+              batch.reserve(batch_row_count);
+              while (batch.size() != batch_row_count &&
+                     !(is_at_end = !read_row(in, cols, RowIndices())))
+                batch.push_back(cols);
+              std::unique_lock<std::mutex> guard(lock);
+              batch_condition.wait(guard, [&] {
+                return job->batches.size() < max_batch_count || is_cancelled;
+              });
+              if (is_cancelled)
+                return;
+              job->batches.push_back(std::move(batch));
+              batch_condition.notify_all();
+            }
+          } catch (...) {
+            job->error = std::current_exception();
+          }
+          std::unique_lock<std::mutex> guard(lock);
+          job->is_done = true;
+          batch_condition.notify_all();
+        });
+      }
+
+      Job &job = jobs[shard % thread_count];
+      for (;;) {
+        std::vector<Row> batch;
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          batch_condition.wait(
+              guard, [&] { return !job.batches.empty() || job.is_done; });
+          if (job.batches.empty())
+            break;
+          batch = std::move(job.batches.front());
+          job.batches.pop_front();
+        }
+        batch_condition.notify_all();
+        for (auto &row : batch)
+          call_row_handler(handler, row, RowIndices());
+      }
+      // The rows in front of a broken line are handled just as CSVReader
+      // would have returned them before throwing.
+      if (job.error)
+        std::rethrow_exception(job.error);
+    }
   }
 
-  void set_file_name(const char *file_name) { in.set_file_name(file_name); }
+  // Parses all rows and calls handler(worker, col1, col2, ...) for every row
+  // on the worker threads. Rows of the same file are handled in order by the
+  // same thread.
+  template <class... ColType, class RowHandler>
+  void for_each_row_unordered(RowHandler handler) {
+    static_assert(sizeof...(ColType) >= column_count,
+                  "not enough columns specified");
+    static_assert(sizeof...(ColType) <= column_count,
+                  "too many columns specified");
+    typedef std::tuple<ColType...> Row;
+    typedef typename detail::make_index_sequence<sizeof...(ColType)>::type
+        RowIndices;
+
+    for_each_shard([&](unsigned worker, std::size_t, shard_reader_type &in) {
+      Row cols;
+      while (read_row(in, cols, RowIndices()))
+        call_row_handler(handler, worker, cols, RowIndices());
+    });
+  }
+};
+#endif
 
-  const char *get_truncated_file_name() const {
-    return in.get_truncated_file_name();
+////////////////////////////////////////////////////////////////////////////
+//                            Compressed Input                            //
+////////////////////////////////////////////////////////////////////////////
+
+#if defined(CSV_IO_ZLIB) || defined(CSV_IO_ZSTD)
+namespace error {
+struct invalid_compressed_data : base, with_file_name {
+  void format_error_message() const override {
+    std::snprintf(error_message_buffer, sizeof(error_message_buffer),
+                  "The compressed data in file \"%s\" is corrupt or truncated.",
+                  file_name);
   }
+};
+} // namespace error
 
-  void set_file_line(unsigned file_line) { in.set_file_line(file_line); }
+namespace detail {
+inline unsigned default_thread_count() {
+#ifndef CSV_IO_NO_THREAD
+  return std::thread::hardware_concurrency();
+#else
+  return 1;
+#endif
+}
 
-  unsigned get_file_line() const { return in.get_file_line(); }
+// Decompresses a stream that consists of independently compressed frames.
+// codec::find_frame_size delimits the frames, which are then decompressed in
+// batches on several threads. As soon as a frame can not be delimited, for
+// example because the file was not written in small frames, the rest of the
+// stream is decompressed on the calling thread using codec::Stream.
+//
+// A codec provides:
+//
+//   // Returns the size of the frame at the begin of data, 0 if more data is
+//   // needed and -1 if the frame can not be delimited.
+//   static long long find_frame_size(const char *data, std::size_t size);
+//
+//   class FrameDecompressor {
+//     // Appends the decompressed frame to output. Returns false if the
+//     // frame is corrupt.
+//     bool decompress(const char *data, std::size_t size,
+//                     std::vector<char> &output);
+//   };
+//
+//   class Stream {
+//     // Consumes input and produces output. Returns false if the input is
+//     // corrupt.
+//     bool decompress(const char *&in, std::size_t &in_size, char *&out,
+//                     std::size_t &out_size);
+//     // Whether the input consumed so far ends with a complete frame.
+//     bool is_at_frame_end() const;
+//   };
+template <class codec> class DecompressingByteSource : public ByteSourceBase {
+public:
+  DecompressingByteSource(const DecompressingByteSource &) = delete;
+  DecompressingByteSource &operator=(const DecompressingByteSource &) = delete;
+
+  explicit DecompressingByteSource(
+      const char *file_name,
+      unsigned thread_count = default_thread_count()) {
+    init(file_name, open_file(file_name), thread_count);
+  }
+
+  explicit DecompressingByteSource(
+      const std::string &file_name,
+      unsigned thread_count = default_thread_count()) {
+    init(file_name.c_str(), open_file(file_name.c_str()), thread_count);
+  }
+
+  DecompressingByteSource(
+      const char *file_name, std::unique_ptr<ByteSourceBase> compressed_source,
+      unsigned thread_count = default_thread_count()) {
+    init(file_name, std::move(compressed_source), thread_count);
+  }
+
+  DecompressingByteSource(
+      const std::string &file_name,
+      std::unique_ptr<ByteSourceBase> compressed_source,
+      unsigned thread_count = default_thread_count()) {
+    init(file_name.c_str(), std::move(compressed_source), thread_count);
+  }
+
+  int read(char *buffer, int size) override {
+    for (;;) {
+      if (!is_streaming)
+        fill_pipeline();
+      if (batches.empty()) {
+        if (is_streaming)
+          return read_stream(buffer, size);
+        return 0;
+      }
+
+      Batch &batch = *batches.front();
+      wait_for(batch);
+      if (batch.error)
+        std::rethrow_exception(batch.error);
+      std::size_t n = (std::min)(static_cast<std::size_t>(size),
+                                 batch.output.size() - batch.output_begin);
+      if (n != 0) {
+        std::memcpy(buffer, batch.output.data() + batch.output_begin, n);
+        batch.output_begin += n;
+        return static_cast<int>(n);
+      }
+      // The buffers are reused as allocating and faulting in fresh ones
+      // costs more than the decompression of fast codecs.
+      spare_batches.push_back(std::move(batches.front()));
+      batches.pop_front();
+    }
+  }
 
 private:
-  void parse_helper(std::size_t) {}
+  static const std::size_t read_byte_count = 1 << 20;
+  static const std::size_t batch_byte_count = 1 << 20;
+  // Larger frames are not buffered but decompressed as a stream.
+  static const std::size_t max_frame_byte_count = 64 << 20;
+
+  struct Batch {
+    std::vector<char> input;
+    std::vector<std::size_t> frame_sizes;
+    std::vector<char> output;
+    std::size_t output_begin = 0;
+    std::exception_ptr error;
+    bool is_done = false;
+  };
+
+  void init(const char *file_name,
+            std::unique_ptr<ByteSourceBase> compressed_source,
+            unsigned thread_count) {
+    if (file_name != nullptr) {
+      strncpy(this->file_name, file_name, sizeof(this->file_name) - 1);
+      this->file_name[sizeof(this->file_name) - 1] = '\0';
+    } else {
+      this->file_name[0] = '\0';
+    }
+    source = std::move(compressed_source);
+#ifdef CSV_IO_NO_THREAD
+    thread_count = 1;
+#endif
+    if (thread_count == 0)
+      thread_count = 1;
+    max_batch_count = 2 * thread_count;
+    frame_decompressors.reset(
+        new typename codec::FrameDecompressor[thread_count]);
+#ifndef CSV_IO_NO_THREAD
+    if (thread_count > 1)
+      pool.reset(new WorkerPool(thread_count));
+#endif
+  }
 
-  template <class T, class... ColType>
-  void parse_helper(std::size_t r, T &t, ColType &... cols) {
-    if (row[r]) {
-      try {
-        try {
-          ::io::detail::parse<overflow_policy>(row[r], t);
-        } catch (error::with_column_content &err) {
-          err.set_column_content(row[r]);
-          throw;
+  void throw_invalid_compressed_data() const {
+    error::invalid_compressed_data err;
+    err.set_file_name(file_name);
+    throw err;
+  }
+
+  std::size_t buffered_byte_count() const { return input.size() - input_begin; }
+
+  void read_more_input() {
+    input.erase(input.begin(), input.begin() + input_begin);
+    input_begin = 0;
+    std::size_t old_size = input.size();
+    input.resize(old_size + read_byte_count);
+    int n = read_fully(*source, input.data() + old_size,
+                       static_cast<int>(read_byte_count));
+    input.resize(old_size + n);
+    if (static_cast<std::size_t>(n) != read_byte_count)
+      is_source_exhausted = true;
+  }
+
+  void fill_pipeline() {
+    while (batches.size() < max_batch_count) {
+      std::unique_ptr<Batch> batch = get_empty_batch();
+      while (batch->input.size() < batch_byte_count) {
+        long long frame_size = codec::find_frame_size(
+            input.data() + input_begin, buffered_byte_count());
+        if (frame_size > 0) {
+          const char *frame = input.data() + input_begin;
+          batch->input.insert(batch->input.end(), frame, frame + frame_size);
+          batch->frame_sizes.push_back(static_cast<std::size_t>(frame_size));
+          input_begin += static_cast<std::size_t>(frame_size);
+        } else if (frame_size == 0 && !is_source_exhausted &&
+                   buffered_byte_count() < max_frame_byte_count) {
+          read_more_input();
+        } else {
+          // Either the end was reached or the rest is handed to the stream
+          // decompressor, which also reports truncated or corrupt data.
+          if (buffered_byte_count() != 0 || !is_source_exhausted)
+            is_streaming = true;
+          break;
         }
-      } catch (error::with_column_name &err) {
-        err.set_column_name(column_names[r].c_str());
-        throw;
       }
+      if (!batch->input.empty())
+        submit(std::move(batch));
+      if (is_streaming || (is_source_exhausted && buffered_byte_count() == 0))
+        return;
     }
-    parse_helper(r + 1, cols...);
   }
 
-public:
-  template <class... ColType> bool read_row(ColType &... cols) {
-    static_assert(sizeof...(ColType) >= column_count,
-                  "not enough columns specified");
-    static_assert(sizeof...(ColType) <= column_count,
-                  "too many columns specified");
+  std::unique_ptr<Batch> get_empty_batch() {
+    if (spare_batches.empty())
+      return std::unique_ptr<Batch>(new Batch);
+    std::unique_ptr<Batch> batch = std::move(spare_batches.back());
+    spare_batches.pop_back();
+    batch->input.clear();
+    batch->frame_sizes.clear();
+    batch->output.clear();
+    batch->output_begin = 0;
+    batch->error = nullptr;
+    batch->is_done = false;
+    return batch;
+  }
+
+  void decompress_batch(Batch &batch, unsigned worker) const {
     try {
-      try {
+      const char *frame = batch.input.data();
+      for (std::size_t frame_size : batch.frame_sizes) {
+        if (!frame_decompressors[worker].decompress(frame, frame_size,
+                                                    batch.output))
+          throw_invalid_compressed_data();
+        frame += frame_size;
+      }
+    } catch (...) {
+      batch.error = std::current_exception();
+    }
+  }
 
-        char *line;
-        do {
-          line = in.next_line();
-          if (!line)
-            return false;
-        } while (comment_policy::is_comment(line));
+  void submit(std::unique_ptr<Batch> batch) {
+    Batch *p = batch.get();
+    batches.push_back(std::move(batch));
+#ifndef CSV_IO_NO_THREAD
+    if (pool) {
+      pool->submit([this, p](unsigned worker) {
+        decompress_batch(*p, worker);
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          p->is_done = true;
+        }
+        batch_done_condition.notify_all();
+      });
+      return;
+    }
+#endif
+    decompress_batch(*p, 0);
+    p->is_done = true;
+  }
 
-        detail::parse_line<trim_policy, quote_policy>(line, row, col_order);
+  void wait_for(Batch &batch) {
+#ifndef CSV_IO_NO_THREAD
+    if (pool) {
+      std::unique_lock<std::mutex> guard(lock);
+      batch_done_condition.wait(guard, [&] { return batch.is_done; });
+    }
+#endif
+    (void)batch;
+  }
 
-        parse_helper(0, cols...);
-      } catch (error::with_file_name &err) {
-        err.set_file_name(in.get_truncated_file_name());
-        throw;
+  int read_stream(char *buffer, int size) {
+    if (!stream)
+      stream.reset(new typename codec::Stream);
+    for (;;) {
+      if (buffered_byte_count() == 0 && !is_source_exhausted)
+        read_more_input();
+
+      const char *in = input.data() + input_begin;
+      std::size_t in_size = buffered_byte_count();
+      char *out = buffer;
+      std::size_t out_size = static_cast<std::size_t>(size);
+      if (!stream->decompress(in, in_size, out, out_size))
+        throw_invalid_compressed_data();
+      std::size_t consumed_byte_count = buffered_byte_count() - in_size;
+      input_begin += consumed_byte_count;
+
+      if (out != buffer)
+        return static_cast<int>(out - buffer);
+      if (in_size == 0 && is_source_exhausted) {
+        if (!stream->is_at_frame_end())
+          throw_invalid_compressed_data();
+        return 0;
       }
-    } catch (error::with_file_line &err) {
-      err.set_file_line(in.get_file_line());
-      throw;
+      // A decompressor that neither consumes nor produces is stuck on
+      // garbage.
+      if (consumed_byte_count == 0 && in_size != 0)
+        throw_invalid_compressed_data();
     }
+  }
 
-    return true;
+  char file_name[error::max_file_name_length + 1];
+  std::unique_ptr<ByteSourceBase> source;
+
+  std::vector<char> input;
+  std::size_t input_begin = 0;
+  bool is_source_exhausted = false;
+
+  std::deque<std::unique_ptr<Batch>> batches;
+  std::vector<std::unique_ptr<Batch>> spare_batches;
+  std::size_t max_batch_count;
+  std::unique_ptr<typename codec::FrameDecompressor[]> frame_decompressors;
+
+  bool is_streaming = false;
+  std::unique_ptr<typename codec::Stream> stream;
+
+#ifndef CSV_IO_NO_THREAD
+  std::mutex lock;
+  std::condition_variable batch_done_condition;
+  // Declared last so that the workers are joined before anything they use
+  // is destroyed.
+  std::unique_ptr<WorkerPool> pool;
+#endif
+};
+
+#ifdef CSV_IO_ZLIB
+// BGZF files, as written by bgzip, are concatenated gzip members of at most
+// 64 KiB that store their compressed size in an extra field. Other gzip files
+// are decompressed as a stream.
+struct gzip_codec {
+  static long long find_frame_size(const char *data, std::size_t size) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    if (size < 12)
+      return size >= 4 && !has_extra_field(p) ? -1 : 0;
+    if (!has_extra_field(p))
+      return -1;
+    std::size_t extra_field_length = p[10] | (p[11] << 8);
+    if (size < 12 + extra_field_length)
+      return 0;
+    const unsigned char *field = p + 12;
+    const unsigned char *field_end = field + extra_field_length;
+    while (field_end - field >= 4) {
+      std::size_t field_length = field[2] | (field[3] << 8);
+      if (field[0] == 'B' && field[1] == 'C' && field_length == 2 &&
+          field_end - field >= 6) {
+        std::size_t frame_size = (field[4] | (field[5] << 8)) + 1;
+        return size < frame_size ? 0 : static_cast<long long>(frame_size);
+      }
+      field += 4 + field_length;
+    }
+    return -1;
+  }
+
+  // Reused for all frames decompressed by one thread.
+  class FrameDecompressor {
+  public:
+    FrameDecompressor() {
+      std::memset(&z, 0, sizeof(z));
+      if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK)
+        throw std::bad_alloc();
+    }
+
+    FrameDecompressor(const FrameDecompressor &) = delete;
+    FrameDecompressor &operator=(const FrameDecompressor &) = delete;
+
+    bool decompress(const char *data, std::size_t size,
+                    std::vector<char> &output) {
+      if (size < 18)
+        return false;
+      const unsigned char *end =
+          reinterpret_cast<const unsigned char *>(data) + size;
+      std::size_t decompressed_size =
+          end[-4] | (end[-3] << 8) | (end[-2] << 16) |
+          (static_cast<std::size_t>(end[-1]) << 24);
+      if (decompressed_size > (1 << 16))
+        return false;
+
+      std::size_t old_size = output.size();
+      output.resize(old_size + decompressed_size);
+      inflateReset(&z);
+      z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+      z.avail_in = static_cast<uInt>(size);
+      // inflate rejects a null next_out even if avail_out is 0, which is the
+      // case for the empty EOF block that ends every BGZF file and that may
+      // be the first frame of a batch with an unallocated output.
+      Bytef empty_output;
+      z.next_out = decompressed_size != 0
+                       ? reinterpret_cast<Bytef *>(output.data() + old_size)
+                       : &empty_output;
+      z.avail_out = static_cast<uInt>(decompressed_size);
+      return inflate(&z, Z_FINISH) == Z_STREAM_END && z.avail_out == 0;
+    }
+
+    ~FrameDecompressor() { inflateEnd(&z); }
+
+  private:
+    z_stream z;
+  };
+
+  class Stream {
+  public:
+    Stream() {
+      std::memset(&z, 0, sizeof(z));
+      // 32 enables the automatic detection of gzip and zlib headers.
+      if (inflateInit2(&z, 32 + MAX_WBITS) != Z_OK)
+        throw std::bad_alloc();
+    }
+
+    Stream(const Stream &) = delete;
+    Stream &operator=(const Stream &) = delete;
+
+    bool decompress(const char *&in, std::size_t &in_size, char *&out,
+                    std::size_t &out_size) {
+      if (in_size != 0 && is_at_member_end) {
+        // Concatenated gzip members, as written by for example pigz.
+        inflateReset(&z);
+        is_at_member_end = false;
+      }
+      uInt in_chunk = static_cast<uInt>(
+          (std::min)(in_size, static_cast<std::size_t>(max_chunk)));
+      uInt out_chunk = static_cast<uInt>(
+          (std::min)(out_size, static_cast<std::size_t>(max_chunk)));
+      z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in));
+      z.avail_in = in_chunk;
+      z.next_out = reinterpret_cast<Bytef *>(out);
+      z.avail_out = out_chunk;
+      int result = inflate(&z, Z_NO_FLUSH);
+      in += in_chunk - z.avail_in;
+      in_size -= in_chunk - z.avail_in;
+      out += out_chunk - z.avail_out;
+      out_size -= out_chunk - z.avail_out;
+      if (result == Z_STREAM_END)
+        is_at_member_end = true;
+      return result == Z_OK || result == Z_STREAM_END || result == Z_BUF_ERROR;
+    }
+
+    bool is_at_frame_end() const { return is_at_member_end; }
+
+    ~Stream() { inflateEnd(&z); }
+
+  private:
+    static const uInt max_chunk = 1u << 30;
+    z_stream z;
+    bool is_at_member_end = true;
+  };
+
+private:
+  static bool has_extra_field(const unsigned char *p) {
+    return p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 && (p[3] & 4) != 0;
+  }
+};
+#endif
+
+#ifdef CSV_IO_ZSTD
+// Files with several zstd frames, as written for example by pzstd or by
+// seekable zstd, are decompressed frame by frame in parallel. A single large
+// frame is decompressed as a stream.
+struct zstd_codec {
+  static long long find_frame_size(const char *data, std::size_t size) {
+    if (size < 4)
+      return 0;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    unsigned magic = p[0] | (p[1] << 8) | (p[2] << 16) |
+                     (static_cast<unsigned>(p[3]) << 24);
+    bool is_skippable = (magic & 0xFFFFFFF0U) == 0x184D2A50U;
+    if (magic != 0xFD2FB528U && !is_skippable)
+      return -1;
+    std::size_t frame_size = ZSTD_findFrameCompressedSize(data, size);
+    // An error usually means that the frame is incomplete. Corrupt frames
+    // end up in the stream decompressor, which reports them.
+    if (ZSTD_isError(frame_size))
+      return 0;
+    return static_cast<long long>(frame_size);
   }
+
+  // Reused for all frames decompressed by one thread.
+  class FrameDecompressor {
+  public:
+    FrameDecompressor() : context(ZSTD_createDCtx()) {
+      if (context == nullptr)
+        throw std::bad_alloc();
+    }
+
+    FrameDecompressor(const FrameDecompressor &) = delete;
+    FrameDecompressor &operator=(const FrameDecompressor &) = delete;
+
+    bool decompress(const char *data, std::size_t size,
+                    std::vector<char> &output) {
+      std::size_t output_size = output.size();
+      unsigned long long content_size = ZSTD_getFrameContentSize(data, size);
+      bool is_content_size_known = content_size <= max_frame_content_size;
+
+      // Decompressing in one go avoids the window sized buffers of the
+      // streaming interface. If the frame does not store its size, as for
+      // example when it was compressed from a pipe, the size is guessed
+      // from the previous frame.
+      std::size_t capacity = is_content_size_known
+                                 ? static_cast<std::size_t>(content_size)
+                                 : expected_ratio * size + (1 << 16);
+      output.resize(output_size + capacity);
+      std::size_t result = ZSTD_decompressDCtx(
+          context, output.data() + output_size, capacity, data, size);
+      if (!ZSTD_isError(result)) {
+        output.resize(output_size + result);
+        expected_ratio = result / size * 5 / 4 + 1;
+        return !is_content_size_known || result == content_size;
+      }
+      output.resize(output_size);
+      if (is_content_size_known)
+        return false;
+
+      // Either the guess was too small or the frame is corrupt.
+      std::size_t frame_begin = output_size;
+      ZSTD_DCtx_reset(context, ZSTD_reset_session_only);
+      ZSTD_inBuffer in = {data, size, 0};
+      for (;;) {
+        if (output.size() == output_size)
+          output.resize(2 * output.size() + (1 << 16));
+        ZSTD_outBuffer out = {output.data() + output_size,
+                              output.size() - output_size, 0};
+        result = ZSTD_decompressStream(context, &out, &in);
+        output_size += out.pos;
+        if (ZSTD_isError(result) ||
+            (result != 0 && in.pos == in.size && out.pos != out.size)) {
+          output.resize(output_size);
+          return false;
+        }
+        if (result == 0)
+          break;
+      }
+      output.resize(output_size);
+      expected_ratio = (output_size - frame_begin) / size * 5 / 4 + 1;
+      return true;
+    }
+
+    ~FrameDecompressor() { ZSTD_freeDCtx(context); }
+
+  private:
+    ZSTD_DCtx *context;
+    std::size_t expected_ratio = 8;
+  };
+
+  class Stream {
+  public:
+    Stream() : context(ZSTD_createDCtx()) {
+      if (context == nullptr)
+        throw std::bad_alloc();
+    }
+
+    Stream(const Stream &) = delete;
+    Stream &operator=(const Stream &) = delete;
+
+    bool decompress(const char *&in, std::size_t &in_size, char *&out,
+                    std::size_t &out_size) {
+      ZSTD_inBuffer in_buffer = {in, in_size, 0};
+      ZSTD_outBuffer out_buffer = {out, out_size, 0};
+      std::size_t result =
+          ZSTD_decompressStream(context, &out_buffer, &in_buffer);
+      in += in_buffer.pos;
+      in_size -= in_buffer.pos;
+      out += out_buffer.pos;
+      out_size -= out_buffer.pos;
+      if (ZSTD_isError(result))
+        return false;
+      // Only a completely flushed frame returns 0.
+      if (in_buffer.pos != 0 || out_buffer.pos != 0)
+        is_at_end_of_frame = result == 0;
+      return true;
+    }
+
+    bool is_at_frame_end() const { return is_at_end_of_frame; }
+
+    ~Stream() { ZSTD_freeDCtx(context); }
+
+  private:
+    ZSTD_DCtx *context;
+    bool is_at_end_of_frame = true;
+  };
+
+private:
+  // Larger content sizes are not trusted to preallocate the output.
+  static const unsigned long long max_frame_content_size = 1ULL << 30;
 };
+#endif
+} // namespace detail
+
+#ifdef CSV_IO_ZLIB
+typedef detail::DecompressingByteSource<detail::gzip_codec> GzipByteSource;
+#endif
+#ifdef CSV_IO_ZSTD
+typedef detail::DecompressingByteSource<detail::zstd_codec> ZstdByteSource;
+#endif
+#endif
 } // namespace io
 #endif